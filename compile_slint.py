@@ -1,12 +1,16 @@
 #!/usr/bin/env python3
 import os
+import re
 import sys
 import shutil
+import time
+import hashlib
 import tarfile
 import requests
 import platform
 import subprocess
 from pathlib import Path
+from concurrent.futures import ThreadPoolExecutor
 
 # Hardcoded Slint version for now
 if os.environ.get("SLINT_VERSION"):
@@ -14,8 +18,16 @@ if os.environ.get("SLINT_VERSION"):
 else:
     SLINT_VERSION = "1.14.1"
 
+def is_native(env):
+    # PlatformIO's "native" platform builds for the host, e.g. the host benchmark
+    return env.get("PIOPLATFORM") == "native"
+
 # See: https://github.com/slint-ui/slint/blob/e41a460b135175a570e39c95985ded246e368bfb/api/cpp/esp-idf/slint/cmake/FindSlint.cmake
 def get_target_arch(env):
+    if is_native(env):
+        # Host SDKs are published under the same platform names as the compiler
+        return get_host_platform()
+
     board_config = env.BoardConfig()
     mcu = board_config.get("build.mcu", "esp32")
     print(f"[Slint_LovyanGFX] Detected MCU: {mcu}")
@@ -136,33 +148,236 @@ def ensure_slint_compiler(lib_dir):
         
     return compiler_path
 
-def compile_slint_file(source, target, env):
-    # This function is called by SCons
-    slint_file = Path(str(source[0]))
-    output_header = Path(str(target[0]))
-    
-    # We need to find the compiler again or pass it via env
-    # For simplicity, we resolve it again (it should be fast)
+# `import { A } from "file.slint";` and `import "font.ttf";`
+IMPORT_RE = re.compile(r'\bimport\s+(?:\{[^}]*\}\s*from\s+)?"([^"]+)"')
+# Embedded images are part of the generated header too
+IMAGE_RE = re.compile(r'@image-url\(\s*"([^"]+)"\s*\)')
+
+def resolve_import(name, base_dir, include_dirs):
+    for d in [base_dir, *include_dirs]:
+        path = Path(d) / name
+        if path.is_file():
+            return path.resolve()
+    # e.g. std-widgets.slint, built into the compiler
+    return None
+
+def scan_dependencies(slint_file, include_dirs):
+    """Returns the .slint file and everything it imports or embeds, recursively."""
+    deps = set()
+    stack = [Path(slint_file).resolve()]
+    while stack:
+        path = stack.pop()
+        if path in deps:
+            continue
+        deps.add(path)
+        if path.suffix != ".slint":
+            continue
+        text = path.read_text(encoding="utf-8", errors="ignore")
+        for name in IMPORT_RE.findall(text) + IMAGE_RE.findall(text):
+            dep = resolve_import(name, path.parent, include_dirs)
+            if dep:
+                stack.append(dep)
+    return sorted(deps)
+
+_compiler_versions = {}
+
+def compiler_version(compiler_path):
+    key = str(compiler_path)
+    if key not in _compiler_versions:
+        result = subprocess.run([key, "--version"], capture_output=True, text=True)
+        _compiler_versions[key] = result.stdout.strip() or SLINT_VERSION
+    return _compiler_versions[key]
+
+def cache_key(deps, version, flags, project_dir):
+    """Hash of everything that goes into a generated header."""
+    h = hashlib.sha256()
+    h.update(version.encode())
+    h.update("\0".join(flags).encode())
+    for dep in deps:
+        h.update(b"\0" + os.path.relpath(dep, project_dir).encode() + b"\0")
+        h.update(dep.read_bytes())
+    return h.hexdigest()
+
+def asset_options(env):
+    """Asset settings from platformio.ini, passed to slint-compiler as environment variables."""
+    options = {}
+    # Only pre-render glyphs at these sizes instead of every size the UI uses, e.g. "12,16,24"
+    font_sizes = env.GetProjectOption("custom_slint_font_sizes", "")
+    if font_sizes:
+        sizes = [s for s in re.split(r"[,\s]+", font_sizes) if s]
+        options["SLINT_FONT_SIZES"] = ",".join(sizes)
+    # Embed images and glyphs at the scale they are shown at
+    scale_factor = env.GetProjectOption("custom_slint_scale_factor", "")
+    if scale_factor:
+        options["SLINT_SCALE_FACTOR"] = str(float(scale_factor))
+    return options
+
+def build_settings(env, compiler_path):
+    """Everything besides the .slint files that changes the generated headers, as one string."""
+    options = asset_options(env)
+    return "\n".join([compiler_version(compiler_path),
+                      *(f"{k}={v}" for k, v in sorted(options.items()))])
+
+def prune_cache(cache_dir, max_bytes, max_age_days):
+    """Drops cached headers unused for max_age_days, then the least recently used ones until
+    the cache fits in max_bytes. Hits refresh a header's modification time."""
+    now = time.time()
+    entries = []
+    for path in cache_dir.iterdir():
+        try:
+            stat = path.stat()
+        except OSError:
+            continue
+        # Temporary files are left behind by interrupted builds
+        stale = now - stat.st_mtime > (max_age_days * 86400 if path.suffix == ".h" else 3600)
+        if stale:
+            path.unlink(missing_ok=True)
+        elif path.suffix == ".h":
+            entries.append((stat.st_mtime, stat.st_size, path))
+    total = sum(size for _, size, _ in entries)
+    for _, size, path in sorted(entries):
+        if total <= max_bytes:
+            break
+        path.unlink(missing_ok=True)
+        total -= size
+
+# Pixel and glyph data of embedded images and fonts, e.g.
+# `inline const uint8_t slint_embedded_resource_3_data[1024] = { 1, 2, ... };`
+RESOURCE_RE = re.compile(
+    r"^[ \t]*((?:\w+[ \t]+)*?)uint8_t[ \t]+slint_embedded_resource_(\d+)(\w*)[ \t]*\[[ \t]*(\d*)[ \t]*\][ \t]*=[ \t]*\{([^}]*)\}",
+    re.M)
+
+# Any mention of a resource, to notice the ones RESOURCE_RE does not recognise
+RESOURCE_ID_RE = re.compile(r"\bslint_embedded_resource_(\d+)")
+
+# The declaration of a resource itself (without suffix), whose type tells what it is, e.g.
+# `inline slint::cbindgen_private::types::StaticTextures slint_embedded_resource_3 = { ... };`
+RESOURCE_DECL_RE = re.compile(
+    r"^[ \t]*(?:(?:inline|static|const|constexpr)[ \t]+)*([\w:]+)[ \t]+slint_embedded_resource_(\d+)[ \t]*(?:\[[^\]]*\][ \t]*)?=",
+    re.M)
+
+# Generated type of the resource -> kind in the report. Files embedded as they are (e.g. a
+# font the software renderer cannot use) are plain byte arrays.
+RESOURCE_KINDS = {"StaticTextures": "image", "BitmapFont": "font", "uint8_t": "data"}
+
+def asset_report(header):
+    """Returns {resource id: [kind, flash bytes, RAM bytes]} for the embedded data of a header,
+    and the ids of resources that are mentioned but whose data was not recognised."""
+    assets = {}
+    text = Path(header).read_text(encoding="utf-8", errors="ignore")
+    kinds = {int(rid): RESOURCE_KINDS.get(type_name.split("::")[-1], "other")
+             for type_name, rid in RESOURCE_DECL_RE.findall(text)}
+    for qualifiers, rid, suffix, size, data in RESOURCE_RE.findall(text):
+        count = int(size) if size else data.count(",") + (1 if data.strip() else 0)
+        entry = assets.setdefault(int(rid), [kinds.get(int(rid), "?"), 0, 0])
+        # Arrays that are not const are copied to RAM at startup
+        entry[1 if "const" in qualifiers.split() else 2] += count
+    unknown = {int(rid) for rid in RESOURCE_ID_RE.findall(text)} - assets.keys()
+    return assets, sorted(unknown)
+
+def print_asset_report(slint_file, header):
+    # The pattern follows the naming of the slint-compiler's generated C++ code; a compiler that
+    # names or declares its resources differently gets a warning instead of a report of 0 bytes.
+    assets, unknown = asset_report(header)
+    print(f"[Slint_LovyanGFX] Embedded assets of {slint_file.name}:")
+    if unknown:
+        print(f"    Warning: not recognised, sizes missing below: resource "
+              f"{', '.join(map(str, unknown))}")
+    if not assets:
+        print("    Warning: no embedded image or font data recognised in the generated header. "
+              "Either the UI embeds none, or this slint-compiler version names it differently "
+              "and the sizes cannot be reported.")
+        return
+    print(f"    {'resource':>8}  {'kind':5}  {'flash':>10}  {'ram':>8}")
+    for rid, (kind, flash, ram) in sorted(assets.items()):
+        print(f"    {rid:>8}  {kind:5}  {flash:>10}  {ram:>8}")
+    flash = sum(a[1] for a in assets.values())
+    ram = sum(a[2] for a in assets.values())
+    print(f"    {'total':>8}  {'':5}  {flash:>10}  {ram:>8}")
+
+def compile_slint_files(source, target, env):
+    # This function is called by SCons with the .slint files and their headers in the same order.
+    # Headers are taken from the cache when their inputs are unchanged; the rest are compiled
+    # in parallel.
     lib_dir = Path(env.get("SLINT_LIB_DIR"))
+    project_dir = Path(env.subst("$PROJECT_DIR"))
+    cache_dir = Path(env.subst("$PROJECT_WORKSPACE_DIR")) / "slint-cache"
+    cache_dir.mkdir(parents=True, exist_ok=True)
     compiler_path = ensure_slint_compiler(lib_dir)
-    
-    output_header.parent.mkdir(parents=True, exist_ok=True)
-    
-    cmd = [
-        str(compiler_path),
-        str(slint_file),
-        "--embed-resources", "embed-for-software-renderer",
-        "-I", str(env.get("PROJECT_DIR")) + "/src/ui", # Include path for imports
-        "-o", str(output_header)
-    ]
-    
-    print(f"[Slint_LovyanGFX] Compiling {slint_file.name}...")
-    result = subprocess.run(cmd, capture_output=True, text=True)
-    
-    if result.returncode != 0:
-        sys.stderr.write(f"Slint compilation failed:\n{result.stderr}\n")
+    version = compiler_version(compiler_path)
+
+    include_dirs = [project_dir / "src" / "ui"]
+    flags = ["--embed-resources", "embed-for-software-renderer"]
+    options = asset_options(env)
+    report = env.GetProjectOption("custom_slint_asset_report", "no").lower() in ("yes", "true", "1")
+    # Paths are hashed relative to the project, so the cache survives moving the checkout
+    hashed_flags = flags + [f"-I{os.path.relpath(d, project_dir)}" for d in include_dirs]
+    hashed_flags += [f"{k}={v}" for k, v in sorted(options.items())]
+
+    def build(slint_file, output_header):
+        deps = scan_dependencies(slint_file, include_dirs)
+        cached = cache_dir / f"{cache_key(deps, version, hashed_flags, project_dir)}.h"
+        output_header.parent.mkdir(parents=True, exist_ok=True)
+        if cached.exists():
+            print(f"[Slint_LovyanGFX] {slint_file.name} unchanged, using cached header")
+            shutil.copyfile(cached, output_header)
+            os.utime(cached)
+            if report:
+                print_asset_report(slint_file, output_header)
+            return None
+
+        cmd = [str(compiler_path), str(slint_file), *flags]
+        for d in include_dirs:
+            cmd += ["-I", str(d)]
+        cmd += ["-o", str(output_header)]
+        print(f"[Slint_LovyanGFX] Compiling {slint_file.name}...")
+        result = subprocess.run(cmd, capture_output=True, text=True,
+                                env={**os.environ, **options})
+        if result.returncode != 0:
+            return f"{slint_file.name}:\n{result.stderr}"
+        if report:
+            print_asset_report(slint_file, output_header)
+        # Write to a temporary name first so that parallel builds never see a partial header
+        tmp = cached.with_suffix(f".{os.getpid()}.tmp")
+        shutil.copyfile(output_header, tmp)
+        os.replace(tmp, cached)
+        return None
+
+    pairs = [(Path(str(s)), Path(str(t))) for s, t in zip(source, target)]
+    jobs = env.GetOption("num_jobs") or os.cpu_count() or 1
+    with ThreadPoolExecutor(max_workers=max(1, min(jobs, len(pairs)))) as pool:
+        errors = [e for e in pool.map(lambda p: build(*p), pairs) if e]
+
+    # Size in MB and age in days, e.g. `custom_slint_cache_size = 16`
+    prune_cache(cache_dir,
+                float(env.GetProjectOption("custom_slint_cache_size", "64")) * 1024 * 1024,
+                float(env.GetProjectOption("custom_slint_cache_days", "30")))
+
+    if errors:
+        sys.stderr.write("Slint compilation failed:\n" + "\n".join(errors) + "\n")
         env.Exit(1)
 
+# Allocator entry points the Slint runtime may call
+ALLOCATOR_SYMBOLS = ["malloc", "calloc", "realloc", "free", "aligned_alloc", "memalign", "posix_memalign"]
+
+def redirect_allocator(env, sdk_dir):
+    """Copy of libslint_cpp.a whose allocator calls go to the platform's arena (slint_lgfx_*)."""
+    lib = sdk_dir / "lib" / "libslint_cpp.a"
+    out_dir = Path(env.subst("$BUILD_DIR")) / "slint-arena"
+    out = out_dir / lib.name
+    if out.exists() and out.stat().st_mtime >= lib.stat().st_mtime:
+        return out_dir
+
+    # $OBJCOPY is esptool on ESP32 platforms; use the toolchain's objcopy next to the compiler
+    objcopy = re.sub(r"g?cc(\.exe)?$", r"objcopy\1", env.subst("$CC"))
+    args = [objcopy]
+    for sym in ALLOCATOR_SYMBOLS:
+        args += ["--redefine-sym", f"{sym}=slint_lgfx_{sym}"]
+    out_dir.mkdir(parents=True, exist_ok=True)
+    print("[Slint_LovyanGFX] Routing Slint runtime allocations to the arena")
+    subprocess.run(args + [str(lib), str(out)], check=True, env=env["ENV"])
+    return out_dir
+
 def configure_env(env):
     import inspect
     try:
@@ -178,14 +393,26 @@ def configure_env(env):
         str(sdk_dir / "include"),
         str(sdk_dir / "include" / "slint")
     ])
-    env.Append(LIBPATH=[str(sdk_dir / "lib")])
+    lib_path = sdk_dir / "lib"
+    if env.GetProjectOption("custom_slint_arena", "no").lower() in ("yes", "true", "1"):
+        if is_native(env):
+            # The host SDK is a shared library, which keeps its own allocator
+            print("[Slint_LovyanGFX] custom_slint_arena is ignored for native builds")
+        else:
+            lib_path = redirect_allocator(env, sdk_dir)
+    env.Append(LIBPATH=[str(lib_path)])
     env.Append(LIBS=["slint_cpp"])
+
+    if is_native(env):
+        # The host SDK ships a shared library; find it at run time without LD_LIBRARY_PATH
+        if platform.system() != "Windows":
+            env.Append(LINKFLAGS=[f"-Wl,-rpath,{sdk_dir / 'lib'}"])
     
     # Linker Script (esp-println.x)
     # This is needed for Rust panic handling on ESP
     # See: https://github.com/slint-ui/slint/blob/e41a460b135175a570e39c95985ded246e368bfb/api/cpp/esp-idf/slint/esp-println.x
     ld_script = lib_dir / "esp-println.x"
-    if ld_script.exists():
+    if ld_script.exists() and not is_native(env):
         env.Append(LIBPATH=[str(lib_dir)])
         # Use -T to specify linker script
         env.Append(LINKFLAGS=[f"-T{ld_script.name}"])
@@ -207,18 +434,26 @@ def configure_env(env):
         
         for slint_file in slint_files:
             header_name = slint_file.with_suffix(".h").name
-            header_file = generated_dir / header_name
-            
-            # We use the library env to define the command, but it needs to run before main build.
-            # Adding it as a dependency to the library or global build.
-            
-            env.Command(
-                str(header_file),
-                str(slint_file),
-                compile_slint_file
-            )
-            generated_headers.append(str(header_file))
-            
+            generated_headers.append(str(generated_dir / header_name))
+
+        # We use the library env to define the command, but it needs to run before main build.
+        # Adding it as a dependency to the library or global build.
+        # One command for all files, so that they compile in parallel; unchanged ones come
+        # from the cache.
+        env.Command(
+            generated_headers,
+            [str(f) for f in slint_files],
+            compile_slint_files
+        )
+        # Changes to imported files and embedded images must trigger a rebuild too
+        deps = set()
+        for slint_file in slint_files:
+            deps.update(scan_dependencies(slint_file, [ui_dir]))
+        env.Depends(generated_headers, sorted(str(d) for d in deps))
+        # So do the asset options and a different compiler
+        env.Depends(generated_headers,
+                    env.Value(build_settings(env, ensure_slint_compiler(lib_dir))))
+
         # Force generation before compiling source files
         # We can attach it to the compilation of the library itself, 
         # or try to attach to main.cpp if we can find it.
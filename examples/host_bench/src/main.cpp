@@ -0,0 +1,275 @@
+#include <slint-lgfx.h> // Must be the first included header
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "esp_timer.h"
+#include "bench-scenes.h" // Generated header in .pio/build/native/Slint_LovyanGFX_generated/
+
+// Usage: program [frames] [bus MHz] [transaction us]
+// Each scene runs once per buffering mode, in a child process of its own because the Slint
+// platform can only be set once.
+
+using Pixel = slint::platform::Rgb565Pixel;
+
+struct Mode
+{
+    const char *name;
+    int buffers;
+    std::optional<int> flush_task_core;
+    /// Library-allocated frame buffers instead of caller buffers.
+    SlintBufferPlacement placement = SlintBufferPlacement::None;
+    uint32_t band_lines = 16;
+    SlintPanelFormat format = SlintPanelFormat::Auto;
+};
+
+static const Mode modes[] = {
+    {"bands", 0, {}},
+    // One line per band: shows the fixed cost paid for every rendered line.
+    {"lines", 0, {}, SlintBufferPlacement::None, 1},
+    {"single", 1, {}},
+    {"double", 2, {}},
+    {"pipeline", 2, 0},
+    // The stand-in panel treats these as PSRAM buffers: pushes go through the band buffers.
+    {"psram", 2, {}, SlintBufferPlacement::Psram},
+    // Dithered 8-bit output to a panel running at 8 bits per pixel.
+    {"rgb332", 0, {}, SlintBufferPlacement::None, 16, SlintPanelFormat::Rgb332},
+};
+
+/// Runs `component` for `frames` steps, calling `step(frame)` once per event loop iteration.
+template <typename Component>
+static void drive(slint::ComponentHandle<Component> component, int frames,
+                  std::function<void(Component &, int)> step, std::function<void()> done)
+{
+    int frame = 0;
+    slint::Timer timer(std::chrono::milliseconds(1),
+                       [&]
+                       {
+                           if (frame == frames)
+                           {
+                               done();
+                               slint::quit_event_loop();
+                               return;
+                           }
+                           step(*component, frame++);
+                       });
+    component->run();
+}
+
+struct Scene
+{
+    const char *name;
+    std::function<void(int frames, std::function<void()> done)> run;
+};
+
+static const Scene scenes[] = {
+    {"counter",
+     [](int frames, auto done)
+     {
+         drive<MainWindow>(MainWindow::create(), frames,
+                           [](auto &ui, int frame) { ui.set_counter(frame); }, done);
+     }},
+    {"moving-box",
+     [](int frames, auto done)
+     {
+         drive<MovingBoxScene>(MovingBoxScene::create(), frames,
+                               [](auto &ui, int frame) { ui.set_frame(frame); }, done);
+     }},
+    {"scroll",
+     [](int frames, auto done)
+     {
+         drive<ScrollScene>(ScrollScene::create(), frames,
+                            [](auto &ui, int frame) { ui.set_frame(frame); }, done);
+     }},
+    {"fade",
+     [](int frames, auto done)
+     {
+         drive<FadeScene>(FadeScene::create(), frames,
+                          [](auto &ui, int frame) { ui.set_frame(frame); }, done);
+     }},
+};
+
+// The arena functions that compile_slint.py renames the Slint runtime's allocator calls to.
+extern "C"
+{
+    void *slint_lgfx_malloc(std::size_t size);
+    void *slint_lgfx_realloc(void *p, std::size_t size);
+    void slint_lgfx_free(void *p);
+    void *slint_lgfx_aligned_alloc(std::size_t align, std::size_t size);
+}
+
+/// Allocates through the arena and the C library and frees each block through the arena's
+/// free()/realloc(), as the renamed Slint runtime does. Returns whether every block kept its
+/// contents; a block sent to the wrong heap aborts in the C library's free().
+static bool check_allocator()
+{
+    static lgfx::LGFX_Device panel(320, 240);
+    slint_esp_init(SlintPlatformConfiguration<Pixel>{
+        .size = slint::PhysicalSize({uint32_t(panel.width()), uint32_t(panel.height())}),
+        .gfx = &panel,
+        .arena_size = 64 * 1024});
+
+    bool ok = true;
+    auto fill = [](void *p, std::size_t size, uint8_t value)
+    { return static_cast<uint8_t *>(memset(p, value, size)); };
+    auto holds = [](const void *p, std::size_t size, uint8_t value)
+    {
+        auto bytes = static_cast<const uint8_t *>(p);
+        return std::all_of(bytes, bytes + size, [&](uint8_t b) { return b == value; });
+    };
+    for (std::size_t size : {1, 24, 100, 3000, 100000})
+    {
+        auto ours = fill(slint_lgfx_malloc(size), size, 0xA5);
+        auto system = fill(malloc(size), size, 0x5A);
+        auto aligned = fill(slint_lgfx_aligned_alloc(64, size), size, 0x3C);
+        ok &= reinterpret_cast<uintptr_t>(aligned) % 64 == 0;
+
+        ours = static_cast<uint8_t *>(slint_lgfx_realloc(ours, size * 2));
+        system = static_cast<uint8_t *>(slint_lgfx_realloc(system, size * 2));
+        aligned = static_cast<uint8_t *>(slint_lgfx_realloc(aligned, size * 2));
+        ok &= holds(ours, size, 0xA5) && holds(system, size, 0x5A) && holds(aligned, size, 0x3C);
+
+        slint_lgfx_free(ours);
+        slint_lgfx_free(system);
+        slint_lgfx_free(aligned);
+        // The reverse direction: an arena block handed back before a system one.
+        auto later = fill(malloc(size), size, 0x11);
+        slint_lgfx_free(slint_lgfx_malloc(size));
+        slint_lgfx_free(later);
+    }
+    slint_lgfx_free(nullptr);
+    return ok;
+}
+
+static void run_case(const Scene &scene, const Mode &mode, int frames, uint32_t bus_bytes_per_s,
+                     uint32_t transaction_us)
+{
+    static lgfx::LGFX_Device panel(320, 240);
+    panel.setBusSpeed(bus_bytes_per_s, transaction_us);
+    if (mode.format == SlintPanelFormat::Rgb332)
+        panel.setColorDepth(lgfx::color_depth_t::rgb332_1Byte);
+
+    std::vector<Pixel> buffer1, buffer2;
+    SlintPlatformConfiguration config{
+        .size = slint::PhysicalSize({uint32_t(panel.width()), uint32_t(panel.height())}),
+        .gfx = &panel,
+        .byte_swap = true,
+        .panel_format = mode.format,
+        .band_lines = mode.band_lines,
+        .flush_task_core = mode.flush_task_core};
+    if (mode.placement != SlintBufferPlacement::None)
+    {
+        config.buffer_placement = mode.placement;
+        config.frame_buffers = mode.buffers;
+    }
+    else if (mode.buffers >= 1)
+    {
+        buffer1.resize(panel.width() * panel.height());
+        config.buffer1 = std::span<Pixel>(buffer1);
+    }
+    if (mode.placement == SlintBufferPlacement::None && mode.buffers >= 2)
+    {
+        buffer2.resize(panel.width() * panel.height());
+        config.buffer2 = std::span<Pixel>(buffer2);
+    }
+    slint_esp_init(config);
+
+    // With HOST_BENCH_MIRROR=<dir>, each case records its mirror stream for host/mirror_decode.py.
+    FILE *mirror = nullptr;
+    if (auto dir = getenv("HOST_BENCH_MIRROR"))
+    {
+        auto path = std::string(dir) + "/" + scene.name + "-" + mode.name + ".slm";
+        mirror = fopen(path.c_str(), "wb");
+    }
+    if (mirror)
+    {
+        slint_esp_mirror_start([](const void *data, std::size_t size, void *file)
+                               { return fwrite(data, 1, size, static_cast<FILE *>(file)); },
+                               mirror, 0);
+    }
+
+    int64_t start = esp_timer_get_time();
+    uint64_t frames_done = 0, bytes = 0, transactions = 0;
+    scene.run(frames,
+              [&]
+              {
+                  frames_done = slint_esp_pacing_stats().frames;
+                  bytes = panel.bytes();
+                  transactions = panel.transactions();
+              });
+    double seconds = (esp_timer_get_time() - start) / 1e6;
+    if (mirror)
+    {
+        // The process ends with _exit(), which does not flush stdio.
+        slint_esp_mirror_stop();
+        fflush(mirror);
+    }
+
+    auto profile = slint_esp_profile_summary();
+    frames_done = std::max<uint64_t>(frames_done, 1);
+    printf("%-11s %-9s %8.1f %10llu %7.1f %9lu %9lu %9lu %9lu\n", scene.name, mode.name,
+           frames_done / seconds, (unsigned long long)(bytes / frames_done),
+           double(transactions) / frames_done, (unsigned long)profile.render_us.avg,
+           (unsigned long)profile.render_us.p99, (unsigned long)profile.convert_us.avg,
+           (unsigned long)profile.push_us.avg);
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 300;
+    double bus_mhz = argc > 2 ? atof(argv[2]) : 40;
+    uint32_t transaction_us = argc > 3 ? atoi(argv[3]) : 20;
+    auto bus_bytes_per_s = uint32_t(bus_mhz * 1e6 / 8);
+
+    printf("320x240 RGB565, %d frames, %.0f MHz bus, %u us per transaction\n", frames, bus_mhz,
+           (unsigned)transaction_us);
+    printf("%-11s %-9s %8s %10s %7s %9s %9s %9s %9s\n", "scene", "mode", "fps", "bytes/frm",
+           "tx/frm", "render", "render99", "convert", "push");
+
+    fflush(stdout);
+    if (auto pid = fork(); pid == 0)
+    {
+        _exit(check_allocator() ? 0 : 1);
+    }
+    else
+    {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            printf("arena allocator check failed\n");
+            return 1;
+        }
+    }
+
+    for (auto &scene : scenes)
+    {
+        for (auto &mode : modes)
+        {
+            fflush(stdout);
+            auto pid = fork();
+            if (pid == 0)
+            {
+                run_case(scene, mode, frames, bus_bytes_per_s, transaction_us);
+                fflush(stdout);
+                // Skip static destructors; helper tasks are still parked on their threads.
+                _exit(0);
+            }
+            int status = 0;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                printf("%-11s %-9s failed\n", scene.name, mode.name);
+            }
+        }
+    }
+    return 0;
+}
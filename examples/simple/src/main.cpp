@@ -18,7 +18,9 @@ void slint_task(void *pvParameters)
       // .touch_handle = touch_handle,
       // but need LGFX instance instead
       .gfx = &gfx,
-      .byte_swap = true});
+      .byte_swap = true,
+      // Same pin as cfg.pin_int in lgfx.hpp: sleep until touched instead of polling
+      .touch_int_pin = 38});
 
   auto ui = MainWindow::create();
   ui->run();
@@ -48,7 +50,7 @@ void setup()
   xTaskCreatePinnedToCore(
       slint_task,
       "slint_task",
-      8 * 1024, // 8KB stack, need more if UI is complex
+      8 * 1024, // 8KB stack; size it from slint_esp_memory_stats().slint_stack_free_min
       NULL, // Parameters
       1, // Priority
       NULL, // Task handle
@@ -0,0 +1,365 @@
+// Host stand-in for LovyanGFX: a panel that keeps the pushed pixels in memory, records every
+// push window and simulates the time the bus needs to transfer it.
+//
+// Only the part of the LGFX_Device API used by the platform is provided. Pushes with DMA read
+// their source buffer when the simulated transfer completes, so a buffer that is reused too early
+// shows up as corrupted panel contents.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lgfx
+{
+    enum color_depth_t : uint16_t
+    {
+        bit_mask = 0x00FF,
+        alternate = 0x1000,
+        rgb332_1Byte = 8,
+        rgb565_2Byte = 16,
+        rgb666_3Byte = 24 | alternate,
+        rgb888_3Byte = 24,
+    };
+
+    enum epd_mode_t : uint8_t
+    {
+        epd_quality = 1,
+        epd_text = 2,
+        epd_fast = 3,
+        epd_fastest = 4,
+    };
+
+    /// Same memory order as slint::Rgb8Pixel.
+    struct bgr888_t
+    {
+        uint8_t r, g, b;
+    };
+
+    /// R3 G3 B2 in one byte.
+    struct rgb332_t
+    {
+        uint8_t raw;
+    };
+
+    /// A push transaction as seen by the panel.
+    struct PanelWindow
+    {
+        int32_t x, y, w, h;
+        uint32_t bytes;
+    };
+
+    enum bus_type_t
+    {
+        bus_unknown,
+        bus_spi,
+        bus_i2c,
+        bus_parallel8,
+        bus_parallel16,
+        bus_stream,
+        bus_image_push,
+    };
+
+    /// Stands for the SPI/I2C/parallel bus a panel is attached to.
+    struct IBus
+    {
+        virtual ~IBus() = default;
+        virtual bus_type_t busType() const = 0;
+    };
+
+    class Bus_SPI : public IBus
+    {
+    public:
+        struct config_t
+        {
+            int spi_host = 0;
+        };
+        const config_t &config() const { return m_cfg; }
+        void config(const config_t &cfg) { m_cfg = cfg; }
+        bus_type_t busType() const override { return bus_spi; }
+
+    private:
+        config_t m_cfg;
+    };
+
+    class Bus_I2C : public IBus
+    {
+    public:
+        struct config_t
+        {
+            int i2c_port = 0;
+        };
+        const config_t &config() const { return m_cfg; }
+        void config(const config_t &cfg) { m_cfg = cfg; }
+        bus_type_t busType() const override { return bus_i2c; }
+
+    private:
+        config_t m_cfg;
+    };
+
+    class Panel_Device
+    {
+    public:
+        IBus *getBus() const { return m_bus; }
+        void setBus(IBus *bus) { m_bus = bus; }
+
+    private:
+        IBus *m_bus = nullptr;
+    };
+
+    class LGFX_Device
+    {
+    public:
+        LGFX_Device(int32_t width = 320, int32_t height = 240,
+                    color_depth_t depth = rgb565_2Byte)
+            : m_width(width), m_height(height), m_depth(depth), m_pixels(width * height)
+        {
+            // A host of its own per panel, numbered in construction order.
+            static int next_host = 0;
+            m_bus.config({next_host++});
+            m_panel.setBus(&m_bus);
+        }
+
+        bool init() { return true; }
+        /// Each stand-in panel has an SPI host of its own unless setBus() shares one.
+        Panel_Device *getPanel() { return &m_panel; }
+        void setBus(IBus *bus) { m_panel.setBus(bus); }
+        int32_t width() const { return m_rotation & 1 ? m_height : m_width; }
+        int32_t height() const { return m_rotation & 1 ? m_width : m_height; }
+        /// Quarter turns as in LovyanGFX; pushes and readPixel() use the rotated coordinates.
+        void setRotation(uint8_t rotation) { m_rotation = rotation & 7; }
+        uint8_t getRotation() const { return m_rotation; }
+        color_depth_t getColorDepth() const { return m_depth; }
+        void setColorDepth(color_depth_t depth) { m_depth = depth; }
+
+        /// Simulated bus: `bytes_per_second` of payload plus `transaction_us` per push for the
+        /// window setup. A bandwidth of 0 makes pushes free.
+        void setBusSpeed(uint32_t bytes_per_second, uint32_t transaction_us)
+        {
+            std::lock_guard lock(m_mutex);
+            m_bytes_per_second = bytes_per_second;
+            m_transaction_us = transaction_us;
+        }
+
+        void startWrite()
+        {
+            std::lock_guard lock(m_mutex);
+            m_write_depth++;
+        }
+        void endWrite()
+        {
+            std::unique_lock lock(m_mutex);
+            if (m_write_depth && --m_write_depth == 0)
+                complete(lock);
+        }
+
+        /// E-paper: setEPD(true) makes the stand-in report an EPD panel. Refreshes are only
+        /// counted; pushes land in memory right away either way.
+        bool isEPD() const { return m_epd; }
+        void setEPD(bool epd) { m_epd = epd; }
+        void setEpdMode(epd_mode_t mode) { m_epd_mode = mode; }
+        epd_mode_t getEpdMode() const { return m_epd_mode; }
+        void setAutoDisplay(bool enabled) { m_auto_display = enabled; }
+        void display(int32_t, int32_t, int32_t, int32_t)
+        {
+            waitDMA();
+            m_epd_refreshes++;
+        }
+        uint64_t epdRefreshes() const { return m_epd_refreshes; }
+
+        template <typename T>
+        bool getTouch(T *x, T *y)
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_touched)
+                return false;
+            *x = T(m_touch_x);
+            *y = T(m_touch_y);
+            return true;
+        }
+        /// Scripted touch for benchmarks.
+        void setTouch(bool touched, int32_t x = 0, int32_t y = 0)
+        {
+            std::lock_guard lock(m_mutex);
+            m_touched = touched;
+            m_touch_x = x;
+            m_touch_y = y;
+        }
+
+        void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data)
+        {
+            push(x, y, w, h, data, 2, false);
+        }
+        void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const bgr888_t *data)
+        {
+            push(x, y, w, h, data, 3, false);
+        }
+        void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const rgb332_t *data)
+        {
+            push(x, y, w, h, data, 1, false);
+        }
+        void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data)
+        {
+            push(x, y, w, h, data, 2, true);
+        }
+        void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, const bgr888_t *data)
+        {
+            push(x, y, w, h, data, 3, true);
+        }
+        void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, const rgb332_t *data)
+        {
+            push(x, y, w, h, data, 1, true);
+        }
+
+        void waitDMA()
+        {
+            std::unique_lock lock(m_mutex);
+            complete(lock);
+        }
+        bool dmaBusy()
+        {
+            std::lock_guard lock(m_mutex);
+            return m_pending.data && Clock::now() < m_busy_until;
+        }
+
+        // Recording.
+
+        uint64_t transactions() const { return m_transactions; }
+        uint64_t bytes() const { return m_bytes; }
+        /// Push windows since the last clearLog().
+        std::vector<PanelWindow> windows()
+        {
+            std::lock_guard lock(m_mutex);
+            return m_windows;
+        }
+        void clearLog()
+        {
+            std::lock_guard lock(m_mutex);
+            m_windows.clear();
+        }
+
+        /// Panel contents as 0xRRGGBB.
+        uint32_t readPixel(int32_t x, int32_t y) const { return m_pixels[y * width() + x]; }
+
+        bool writePPM(const char *path) const
+        {
+            auto f = fopen(path, "wb");
+            if (!f)
+                return false;
+            fprintf(f, "P6\n%d %d\n255\n", int(width()), int(height()));
+            for (auto p : m_pixels)
+            {
+                uint8_t rgb[3] = {uint8_t(p >> 16), uint8_t(p >> 8), uint8_t(p)};
+                fwrite(rgb, 1, 3, f);
+            }
+            fclose(f);
+            return true;
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Pending
+        {
+            PanelWindow window{};
+            const uint8_t *data = nullptr;
+            uint32_t bpp = 0;
+        };
+
+        void push(int32_t x, int32_t y, int32_t w, int32_t h, const void *data, uint32_t bpp,
+                  bool dma)
+        {
+            std::unique_lock lock(m_mutex);
+            // Like LovyanGFX, a new transfer waits for the previous one.
+            complete(lock);
+
+            uint32_t bytes = uint32_t(w) * h * bpp;
+            m_transactions++;
+            m_bytes += bytes;
+            m_windows.push_back({x, y, w, h, bytes});
+
+            auto cost = std::chrono::microseconds(m_transaction_us);
+            if (m_bytes_per_second)
+                cost += std::chrono::microseconds(uint64_t(bytes) * 1000000 / m_bytes_per_second);
+            m_busy_until = std::max(m_busy_until, Clock::now()) + cost;
+            m_pending = {{x, y, w, h, bytes}, static_cast<const uint8_t *>(data), bpp};
+            if (!dma)
+                complete(lock);
+        }
+
+        /// Waits for the transfer in flight and stores its pixels.
+        void complete(std::unique_lock<std::mutex> &lock)
+        {
+            if (!m_pending.data)
+                return;
+            auto until = m_busy_until;
+            lock.unlock();
+            std::this_thread::sleep_until(until);
+            lock.lock();
+            if (!m_pending.data)
+                return;
+
+            auto &win = m_pending.window;
+            auto src = m_pending.data;
+            for (int32_t row = 0; row < win.h; row++)
+            {
+                for (int32_t col = 0; col < win.w; col++, src += m_pending.bpp)
+                {
+                    int32_t px = win.x + col, py = win.y + row;
+                    if (px < 0 || py < 0 || px >= width() || py >= height())
+                        continue;
+                    uint32_t rgb;
+                    if (m_pending.bpp == 1)
+                    {
+                        // Widened by bit replication, like LovyanGFX.
+                        uint32_t r = *src >> 5, g = (*src >> 2) & 7, b = *src & 3;
+                        rgb = (r * 0x49 >> 1) << 16 | (g * 0x49 >> 1) << 8 | b * 0x55;
+                    }
+                    else if (m_pending.bpp == 2)
+                    {
+                        // Big-endian RGB565, as LovyanGFX takes raw uint16_t data.
+                        uint32_t v = src[0] << 8 | src[1];
+                        rgb = (v >> 11) << 19 | ((v >> 5) & 0x3F) << 10 | (v & 0x1F) << 3;
+                    }
+                    else
+                    {
+                        rgb = uint32_t(src[0]) << 16 | uint32_t(src[1]) << 8 | src[2];
+                    }
+                    m_pixels[py * width() + px] = rgb;
+                }
+            }
+            m_pending = {};
+        }
+
+        int32_t m_width, m_height;
+        color_depth_t m_depth;
+        uint8_t m_rotation = 0;
+        Bus_SPI m_bus;
+        Panel_Device m_panel;
+        std::vector<uint32_t> m_pixels;
+
+        std::mutex m_mutex;
+        uint32_t m_bytes_per_second = 0;
+        uint32_t m_transaction_us = 0;
+        uint32_t m_write_depth = 0;
+        Clock::time_point m_busy_until{};
+        Pending m_pending;
+
+        bool m_epd = false;
+        bool m_auto_display = true;
+        epd_mode_t m_epd_mode = epd_quality;
+        std::atomic<uint64_t> m_epd_refreshes{0};
+
+        bool m_touched = false;
+        int32_t m_touch_x = 0, m_touch_y = 0;
+
+        std::atomic<uint64_t> m_transactions{0};
+        std::atomic<uint64_t> m_bytes{0};
+        std::vector<PanelWindow> m_windows;
+    };
+}
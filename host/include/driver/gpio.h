@@ -0,0 +1,54 @@
+// Host shim: there are no GPIOs on the host, so interrupts cannot be attached and pin-driven
+// features (TE pacing, touch interrupt) fall back to their polling paths.
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+typedef void (*gpio_isr_t)(void *arg);
+
+typedef enum
+{
+    GPIO_INTR_DISABLE,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+    GPIO_INTR_LOW_LEVEL,
+    GPIO_INTR_HIGH_LEVEL,
+} gpio_int_type_t;
+
+typedef enum
+{
+    GPIO_MODE_DISABLE,
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+} gpio_mode_t;
+
+typedef enum
+{
+    GPIO_PULLUP_DISABLE,
+    GPIO_PULLUP_ENABLE,
+} gpio_pullup_t;
+
+typedef enum
+{
+    GPIO_PULLDOWN_DISABLE,
+    GPIO_PULLDOWN_ENABLE,
+} gpio_pulldown_t;
+
+typedef struct
+{
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+inline esp_err_t gpio_config(const gpio_config_t *) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t gpio_install_isr_service(int) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t gpio_isr_handler_add(gpio_num_t, gpio_isr_t, void *)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
@@ -0,0 +1,11 @@
+// Host shim: the "cycle counter" counts nanoseconds (see esp_rom_get_cpu_ticks_per_us()).
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+inline uint32_t esp_cpu_get_cycle_count()
+{
+    using namespace std::chrono;
+    return uint32_t(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
@@ -0,0 +1,35 @@
+// Host shim: capability-based allocation maps to the C heap.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#define MALLOC_CAP_EXEC (1 << 0)
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+inline void *heap_caps_malloc(std::size_t size, uint32_t /*caps*/) { return std::malloc(size); }
+
+inline void *heap_caps_aligned_alloc(std::size_t alignment, std::size_t size, uint32_t /*caps*/)
+{
+    // std::aligned_alloc wants a multiple of the alignment.
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+inline void *heap_caps_realloc(void *ptr, std::size_t size, uint32_t /*caps*/)
+{
+    return std::realloc(ptr, size);
+}
+
+inline void heap_caps_free(void *ptr) { std::free(ptr); }
+
+// The C heap has no figures to report.
+inline std::size_t heap_caps_get_total_size(uint32_t) { return 0; }
+inline std::size_t heap_caps_get_free_size(uint32_t) { return 0; }
+inline std::size_t heap_caps_get_minimum_free_size(uint32_t) { return 0; }
+inline std::size_t heap_caps_get_largest_free_block(uint32_t) { return 0; }
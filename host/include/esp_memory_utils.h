@@ -0,0 +1,4 @@
+// Host shim: there is no external RAM on the host.
+#pragma once
+
+inline bool esp_ptr_external_ram(const void *) { return false; }
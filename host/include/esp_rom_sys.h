@@ -0,0 +1,6 @@
+// Host shim: matches the nanosecond cycle counter of esp_cpu.h.
+#pragma once
+
+#include <cstdint>
+
+inline uint32_t esp_rom_get_cpu_ticks_per_us() { return 1000; }
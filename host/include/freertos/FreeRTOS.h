@@ -0,0 +1,86 @@
+// Host shim: the subset of FreeRTOS used by the platform, on top of std::thread.
+//
+// Every thread that calls into the shim gets a task record lazily, so the main thread can run the
+// Slint event loop as if it were a FreeRTOS task. Ticks are milliseconds.
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks) ((uint32_t)(ticks))
+
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+/// Spinlock guarding critical sections. On the host all critical sections share one mutex.
+typedef struct
+{
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+namespace host_rtos
+{
+    inline std::mutex &critical_section()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+}
+#define portENTER_CRITICAL(mux) ((void)(mux), host_rtos::critical_section().lock())
+#define portEXIT_CRITICAL(mux) ((void)(mux), host_rtos::critical_section().unlock())
+
+/// There are no interrupts on the host.
+inline BaseType_t xPortInIsrContext() { return pdFALSE; }
+
+namespace host_rtos
+{
+    struct Task
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        uint32_t notifications = 0;
+        /// Created by xTaskCreatePinnedToCore rather than adopted from a foreign thread.
+        bool spawned = false;
+    };
+
+    inline Task *&current_task()
+    {
+        thread_local std::unique_ptr<Task> adopted;
+        thread_local Task *current = nullptr;
+        if (!current)
+        {
+            adopted = std::make_unique<Task>();
+            current = adopted.get();
+        }
+        return current;
+    }
+
+    /// Waits on `cv` until `ready()` or `ticks` elapsed; portMAX_DELAY waits forever.
+    template <typename Ready>
+    bool wait(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, TickType_t ticks,
+              Ready ready)
+    {
+        if (ticks == portMAX_DELAY)
+        {
+            cv.wait(lock, ready);
+            return true;
+        }
+        return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+    }
+}
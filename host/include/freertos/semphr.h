@@ -0,0 +1,50 @@
+// Host shim: counting and binary semaphores.
+#pragma once
+
+#include "FreeRTOS.h"
+
+namespace host_rtos
+{
+    struct Semaphore
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        UBaseType_t count = 0;
+        UBaseType_t max = 0;
+    };
+}
+
+typedef host_rtos::Semaphore *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    auto sem = new host_rtos::Semaphore;
+    sem->count = initial;
+    sem->max = max;
+    return sem;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return xSemaphoreCreateCounting(1, 0); }
+
+inline void vSemaphoreDelete(SemaphoreHandle_t sem) { delete sem; }
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    std::unique_lock lock(sem->mutex);
+    if (!host_rtos::wait(sem->cv, lock, ticks, [&] { return sem->count != 0; }))
+        return pdFALSE;
+    sem->count--;
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    {
+        std::lock_guard lock(sem->mutex);
+        if (sem->count == sem->max)
+            return pdFALSE;
+        sem->count++;
+    }
+    sem->cv.notify_one();
+    return pdTRUE;
+}
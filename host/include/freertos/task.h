@@ -0,0 +1,83 @@
+// Host shim: tasks are detached threads, notifications a counter guarded by a condition variable.
+#pragma once
+
+#include <pthread.h>
+#include <thread>
+#include "FreeRTOS.h"
+#include "esp_timer.h"
+
+typedef host_rtos::Task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return host_rtos::current_task(); }
+
+inline TickType_t xTaskGetTickCount() { return TickType_t(esp_timer_get_time() / 1000); }
+
+inline UBaseType_t uxTaskPriorityGet(TaskHandle_t) { return 1; }
+
+/// Host threads have no fixed stack to watch.
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char * /*name*/,
+                                          uint32_t /*stack_depth*/, void *arg,
+                                          UBaseType_t /*priority*/, TaskHandle_t *handle,
+                                          BaseType_t /*core*/)
+{
+    // Tasks live as long as the process, like most tasks on the device.
+    auto task = new host_rtos::Task;
+    task->spawned = true;
+    if (handle)
+        *handle = task;
+    std::thread(
+        [fn, arg, task]
+        {
+            host_rtos::current_task() = task;
+            fn(arg);
+        })
+        .detach();
+    return pdPASS;
+}
+
+/// Deleting the calling task ends its thread. On a thread that was not created as a task (the
+/// main thread) it returns, so that a finished event loop hands control back to the caller.
+inline void vTaskDelete(TaskHandle_t handle)
+{
+    if (!handle && host_rtos::current_task()->spawned)
+        pthread_exit(nullptr);
+}
+
+inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    auto task = host_rtos::current_task();
+    std::unique_lock lock(task->mutex);
+    host_rtos::wait(task->cv, lock, ticks, [&] { return task->notifications != 0; });
+    auto value = task->notifications;
+    if (value)
+        task->notifications = clear_on_exit ? 0 : value - 1;
+    return value;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard lock(task->mutex);
+        task->notifications++;
+    }
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken)
+        *woken = pdFALSE;
+}
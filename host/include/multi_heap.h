@@ -0,0 +1,106 @@
+// Host shim: registered heaps hand out blocks from the C heap and only keep the accounting, so
+// their blocks are never inside the registered region.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+
+struct multi_heap_info
+{
+    std::mutex mutex;
+    std::size_t size = 0;
+    std::size_t allocated = 0;
+    std::size_t min_free = 0;
+    std::unordered_map<void *, std::size_t> blocks;
+
+    void *track(void *p, std::size_t bytes)
+    {
+        if (!p)
+            return nullptr;
+        blocks[p] = bytes;
+        allocated += bytes;
+        min_free = std::min(min_free, size - allocated);
+        return p;
+    }
+};
+
+typedef multi_heap_info *multi_heap_handle_t;
+
+typedef struct
+{
+    std::size_t total_free_bytes;
+    std::size_t total_allocated_bytes;
+    std::size_t largest_free_block;
+    std::size_t minimum_free_bytes;
+    std::size_t allocated_blocks;
+    std::size_t free_blocks;
+    std::size_t total_blocks;
+} multi_heap_info_t;
+
+inline multi_heap_handle_t multi_heap_register(void * /*start*/, std::size_t size)
+{
+    auto heap = new multi_heap_info;
+    heap->size = heap->min_free = size;
+    return heap;
+}
+
+inline void multi_heap_set_lock(multi_heap_handle_t, void *) {}
+
+inline void *multi_heap_malloc(multi_heap_handle_t heap, std::size_t size)
+{
+    std::lock_guard lock(heap->mutex);
+    if (heap->allocated + size > heap->size)
+        return nullptr;
+    return heap->track(std::malloc(size), size);
+}
+
+inline void *multi_heap_aligned_alloc(multi_heap_handle_t heap, std::size_t size,
+                                      std::size_t alignment)
+{
+    std::lock_guard lock(heap->mutex);
+    if (heap->allocated + size > heap->size)
+        return nullptr;
+    auto rounded = (size + alignment - 1) / alignment * alignment;
+    return heap->track(std::aligned_alloc(alignment, rounded), size);
+}
+
+inline void multi_heap_free(multi_heap_handle_t heap, void *p)
+{
+    std::lock_guard lock(heap->mutex);
+    auto it = heap->blocks.find(p);
+    if (it == heap->blocks.end())
+        return;
+    heap->allocated -= it->second;
+    heap->blocks.erase(it);
+    std::free(p);
+}
+
+inline std::size_t multi_heap_get_allocated_size(multi_heap_handle_t heap, void *p)
+{
+    std::lock_guard lock(heap->mutex);
+    auto it = heap->blocks.find(p);
+    return it == heap->blocks.end() ? 0 : it->second;
+}
+
+inline void *multi_heap_realloc(multi_heap_handle_t heap, void *p, std::size_t size)
+{
+    auto old = multi_heap_get_allocated_size(heap, p);
+    auto q = multi_heap_malloc(heap, size);
+    if (q)
+    {
+        std::copy_n(static_cast<const char *>(p), std::min(old, size), static_cast<char *>(q));
+        multi_heap_free(heap, p);
+    }
+    return q;
+}
+
+inline void multi_heap_get_info(multi_heap_handle_t heap, multi_heap_info_t *info)
+{
+    std::lock_guard lock(heap->mutex);
+    auto free = heap->size - heap->allocated;
+    *info = {free, heap->allocated, free, heap->min_free, heap->blocks.size(), 1,
+             heap->blocks.size() + 1};
+}
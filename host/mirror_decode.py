@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Decodes a mirror stream (see src/slint-lgfx-mirror.h) into PPM screenshots.
+
+Usage: mirror_decode.py STREAM OUT_DIR [--last]
+
+Writes OUT_DIR/frame-<sequence>.ppm for every complete frame, or only OUT_DIR/last.ppm with
+--last. Truncated frames are dropped, and deltas are ignored until the next key frame.
+"""
+import struct
+import sys
+from pathlib import Path
+
+MAGIC = b"SLMF"
+BYTES_PER_PIXEL = {0: 2, 1: 2, 2: 3, 3: 3}
+
+
+def to_rgb(fmt, px):
+    if fmt in (0, 1):
+        v = px[0] | px[1] << 8 if fmt == 0 else px[0] << 8 | px[1]
+        r, g, b = v >> 11, (v >> 5) & 0x3F, v & 0x1F
+        return bytes(((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)))
+    return bytes(px) if fmt == 2 else bytes((px[2], px[1], px[0]))
+
+
+class Truncated(Exception):
+    pass
+
+
+class Reader:
+    def __init__(self, data, pos):
+        self.data = data
+        self.pos = pos
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise Truncated()
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+
+def decode_frame(data, start):
+    """Returns (header, rectangles, end) or raises Truncated/ValueError."""
+    r = Reader(data, start + len(MAGIC))
+    seq, width, height, fmt, flags = struct.unpack("<IHHBB", r.take(10))
+    bpp = BYTES_PER_PIXEL.get(fmt)
+    if bpp is None:
+        raise ValueError(f"unknown pixel format {fmt}")
+    rects = []
+    while True:
+        tag = r.take(1)
+        if tag == b"E":
+            (size,) = struct.unpack("<I", r.take(4))
+            if size != r.pos - 5 - start:
+                raise ValueError("frame size mismatch")
+            return (seq, width, height, fmt, flags & 1), rects, r.pos
+        if tag != b"R":
+            raise ValueError(f"unexpected tag {tag!r}")
+        x, y, w, h = struct.unpack("<HHHH", r.take(8))
+        pixels = []
+        for _ in range(h):
+            row = []
+            while len(row) < w:
+                count = r.take(1)[0]
+                if count & 0x80:
+                    row.extend([r.take(bpp)] * ((count & 0x7F) + 1))
+                else:
+                    literal = r.take(bpp * (count + 1))
+                    row.extend(literal[i:i + bpp] for i in range(0, len(literal), bpp))
+            if len(row) != w:
+                raise ValueError("run crosses the end of a row")
+            pixels.append(row)
+        rects.append((x, y, w, h, pixels))
+
+
+def frames(data):
+    """Yields (sequence, width, height, rgb bytes) for every frame that can be shown."""
+    screen = None
+    pos = data.find(MAGIC)
+    while pos >= 0:
+        try:
+            (seq, width, height, fmt, key), rects, end = decode_frame(data, pos)
+        except (Truncated, ValueError):
+            # Wait for the next key frame
+            screen = None
+            pos = data.find(MAGIC, pos + 1)
+            continue
+        if key or (screen is not None and screen[0] == (width, height)):
+            if key:
+                screen = ((width, height), [bytes(3)] * (width * height))
+            pixels = screen[1]
+            for x, y, w, h, rows in rects:
+                for dy, row in enumerate(rows):
+                    for dx, px in enumerate(row):
+                        if x + dx < width and y + dy < height:
+                            pixels[(y + dy) * width + x + dx] = to_rgb(fmt, px)
+            yield seq, width, height, b"".join(pixels)
+        pos = data.find(MAGIC, end)
+
+
+def write_ppm(path, width, height, rgb):
+    with open(path, "wb") as f:
+        f.write(b"P6\n%d %d\n255\n" % (width, height))
+        f.write(rgb)
+
+
+def main(argv):
+    if len(argv) < 3:
+        sys.stderr.write(__doc__)
+        return 2
+    data = Path(argv[1]).read_bytes()
+    out_dir = Path(argv[2])
+    out_dir.mkdir(parents=True, exist_ok=True)
+    last = None
+    count = 0
+    for seq, width, height, rgb in frames(data):
+        count += 1
+        if "--last" in argv:
+            last = (width, height, rgb)
+        else:
+            write_ppm(out_dir / f"frame-{seq:05d}.ppm", width, height, rgb)
+    if last:
+        write_ppm(out_dir / "last.ppm", *last)
+    print(f"{count} frames decoded")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -6,6 +6,97 @@
 #include <vector>
 #include <span>
 #include <optional>
+#include <type_traits>
+
+/**
+ * Pixel format pushed to the panel.
+ */
+enum class SlintPanelFormat
+{
+    /// Chosen from the pixel type and the color depth LovyanGFX reports for the panel.
+    Auto,
+    /// 16-bit RGB565.
+    Rgb565,
+    /// 18-bit RGB666, sent as three bytes per pixel.
+    Rgb666,
+    /// 24-bit RGB888.
+    Rgb888,
+    /// 8-bit RGB332, for slow buses. Only sends fewer bytes when the panel runs at 8 bits per
+    /// pixel (`setColorDepth(8)`); otherwise LovyanGFX widens it again.
+    Rgb332,
+};
+
+/**
+ * Where the library allocates frame buffers.
+ */
+enum class SlintBufferPlacement
+{
+    /// Nothing is allocated: `buffer1`/`buffer2` are used as given, or rendering goes line by
+    /// line without them.
+    None,
+    /// Internal DMA-capable RAM. Dirty rectangles are pushed straight from the frame buffer.
+    Internal,
+    /// PSRAM. Dirty rectangles are converted into internal band buffers and pushed from there,
+    /// so DMA never reads PSRAM.
+    Psram,
+};
+
+/**
+ * What posting to the event loop does when its task queue is full.
+ */
+enum class SlintQueueFullPolicy
+{
+    /// Wait until the event loop has made room. ISRs drop instead, and the Slint task itself
+    /// appends to an overflow list that the event loop runs after the queue.
+    Block,
+    /// Drop the task and count it in `slint_esp_dropped_tasks()`.
+    Drop,
+};
+
+/**
+ * Whether a display is driven as an e-paper panel.
+ */
+enum class SlintEpdMode
+{
+    /// E-paper mode when LovyanGFX reports an EPD panel (`isEPD()`).
+    Auto,
+    Off,
+    On,
+};
+
+/**
+ * Refresh policy of e-paper panels. Frames are pushed to the controller's memory only, and the
+ * panel is refreshed once per batch of changes.
+ */
+struct SlintEpdConfiguration
+{
+    SlintEpdMode mode = SlintEpdMode::Auto;
+    /// Changes are collected for this long after the first one before the panel refreshes.
+    uint32_t batch_ms = 300;
+    /// While animations run, the refresh waits for them to end, but not longer than this.
+    uint32_t animation_hold_ms = 2000;
+    /// Changed area, in percent of the panel, from which a full refresh is used instead of a
+    /// partial one.
+    uint32_t full_refresh_percent = 50;
+    /// Partial refreshes in a row before a full refresh clears the ghosting.
+    uint32_t partial_budget = 10;
+};
+
+/**
+ * Filtering of touch samples before they become pointer events. The defaults pass every sample
+ * through.
+ */
+struct SlintTouchFilterConfiguration
+{
+    /// A contact must last this long to press, and be gone this long to release, so that bounces
+    /// and short dropouts are ignored. The touch controller is polled meanwhile.
+    uint32_t debounce_ms = 0;
+    /// Moves that stay within this many physical pixels of the last reported position are
+    /// dropped.
+    uint32_t jitter_radius = 0;
+    /// Only the last move sampled before a frame is sent, instead of every sample in between.
+    bool coalesce_moves = false;
+};
 
 /**
  * This data structure configures the Slint platform for use with LovyanGFX.
@@ -23,15 +114,362 @@ struct SlintPlatformConfiguration
     /// If specified, this is a second buffer that will be used for double-buffering.
     std::optional<std::span<PixelType>> buffer2 = {};
     
+    /// Clockwise rotation of the UI relative to the panel's current orientation. `size` is the
+    /// size of the rotated UI.
     slint::platform::SoftwareRenderer::RenderingRotation rotation =
         slint::platform::SoftwareRenderer::RenderingRotation::NoRotation;
-        
+    /// Opt-in: rotate with the panel's scan direction (LovyanGFX `setRotation()`, MADCTL on most
+    /// controllers) so the renderer draws in native order. Falls back to rotating in the renderer
+    /// when the panel does not take the rotation. Off by default, so `rotation` keeps rotating in
+    /// the renderer; check the direction of 90 and 270 degree turns on your panel when enabling
+    /// it.
+    bool hardware_rotation = false;
+
+    /// Swap the bytes of RGB565 pixels, or the red and blue channels of RGB888 pixels. Has no
+    /// effect on RGB332 output.
     bool byte_swap = false;
+    /// Pixel format pushed to the panel. `Rgb565Pixel` is pushed as RGB565 or RGB332;
+    /// `Rgb8Pixel` is converted to the format selected here.
+    SlintPanelFormat panel_format = SlintPanelFormat::Auto;
+
+    /// Number of lines rendered into one band before it is pushed, when rendering line by line
+    /// (no `buffer1`).
+    uint32_t band_lines = 16;
+    /// Number of band buffers allocated in internal DMA-capable RAM. With two or more, the next
+    /// band renders while the previous one is still being transferred.
+    uint32_t band_buffers = 2;
+
+    /// If set, byte swapping and pushing run in a separate flush task pinned to this core, while
+    /// rendering stays on the Slint task.
+    std::optional<int> flush_task_core = {};
+
+    /// Cost of one push transaction (window setup, command and DMA start), in bytes on the wire.
+    /// In buffered mode, dirty rectangles are merged, split into rows or promoted to a full frame
+    /// push, whichever sends the fewest bytes under this cost.
+    uint32_t transaction_cost = 64;
+
+    /// GPIO connected to the panel's tearing effect (TE) output, or -1. Pushes then start right
+    /// after the panel signals vertical blanking.
+    int te_pin = -1;
+    /// Frame rate cap, or 0 for none. Frames that fall behind skip to the next slot.
+    uint32_t target_fps = 0;
+
+    /// GPIO connected to the touch controller's interrupt output, or -1 to poll the controller
+    /// every 10 ms. With an interrupt, the event loop sleeps until a touch, timer or task arrives.
+    int touch_int_pin = -1;
+
+    /// Capacity of the queue behind `slint::invoke_from_event_loop()` and `slint_esp_post()`,
+    /// rounded up to a power of two. It is allocated once, so posting never allocates.
+    uint32_t task_queue_size = 32;
+    /// What posting from a task does when the queue is full.
+    SlintQueueFullPolicy task_queue_full = SlintQueueFullPolicy::Block;
+
+    /// E-paper refresh policy.
+    SlintEpdConfiguration epd = {};
+
+    /// If not `None`, the library allocates the frame buffers here instead of taking `buffer1`
+    /// and `buffer2`. Caller buffers in PSRAM are streamed through band buffers as well.
+    SlintBufferPlacement buffer_placement = SlintBufferPlacement::None;
+    /// Number of frame buffers to allocate: 1, or 2 for double buffering.
+    uint32_t frame_buffers = 1;
+
+    /// Size of a heap reserved at start for the Slint runtime and the library's buffers, or 0 to
+    /// use the system heap. The Slint runtime allocates from it when the project sets
+    /// `custom_slint_arena = yes`.
+    uint32_t arena_size = 0;
+    /// Where the arena is reserved: `Internal` (DMA-capable, also used for band buffers) or
+    /// `Psram`.
+    SlintBufferPlacement arena_placement = SlintBufferPlacement::Internal;
+
+    /// Filtering of the touch samples of the first display.
+    SlintTouchFilterConfiguration touch_filter = {};
+
+    /// Ordered (4x4 Bayer) dithering when packing into RGB332, which hides the banding of
+    /// gradients. Turn it off for flat colors that must stay solid.
+    bool dither = true;
+
+    /// Identifies the bus the panel is wired to, for example the SPI host number. Displays with
+    /// the same id never transfer at the same time; displays with different ids do. With -1, SPI
+    /// and I2C buses are told apart by their host or port, and any other bus counts as shared
+    /// with every display. Set it on all displays or on none.
+    int bus_id = -1;
+
+    /// Time-sliced flushing for a bus shared with other devices, such as an SD card: the first
+    /// display (and added displays on its bus) then take the bus per push instead of per frame,
+    /// and hand it to `slint_esp_bus_acquire()` callers after holding it this long. 0 keeps the
+    /// bus for the whole frame.
+    uint32_t bus_slice_us = 0;
+    /// Priority of the display on that bus. Callers with a higher priority get the bus at the
+    /// next push, without waiting for the slice to run out.
+    uint32_t bus_priority = 1;
 };
 
 template <typename... Args>
 SlintPlatformConfiguration(Args...) -> SlintPlatformConfiguration<>;
 
+/**
+ * Configures an additional display, see `slint_esp_add_display()`. The fields have the same
+ * meaning as in `SlintPlatformConfiguration`.
+ */
+template <typename PixelType = slint::platform::Rgb565Pixel>
+struct SlintDisplayConfiguration
+{
+    slint::PhysicalSize size;
+    lgfx::LGFX_Device *gfx = nullptr;
+
+    std::optional<std::span<PixelType>> buffer1 = {};
+    std::optional<std::span<PixelType>> buffer2 = {};
+
+    slint::platform::SoftwareRenderer::RenderingRotation rotation =
+        slint::platform::SoftwareRenderer::RenderingRotation::NoRotation;
+    bool hardware_rotation = false;
+
+    bool byte_swap = false;
+    SlintPanelFormat panel_format = SlintPanelFormat::Auto;
+
+    uint32_t band_lines = 16;
+    uint32_t band_buffers = 2;
+
+    uint32_t transaction_cost = 64;
+
+    /// Poll this display's touch controller and send its events to the display's window.
+    bool touch = false;
+
+    SlintEpdConfiguration epd = {};
+
+    SlintBufferPlacement buffer_placement = SlintBufferPlacement::None;
+    uint32_t frame_buffers = 1;
+
+    SlintTouchFilterConfiguration touch_filter = {};
+
+    bool dither = true;
+
+    int bus_id = -1;
+};
+
+template <typename... Args>
+SlintDisplayConfiguration(Args...) -> SlintDisplayConfiguration<>;
+
+/**
+ * What the last frame sent to the panel.
+ */
+struct SlintFlushStats
+{
+    /// Dirty rectangles (or bands, when rendering line by line) that were rendered.
+    uint32_t rectangles = 0;
+    /// Push transactions issued to LovyanGFX.
+    uint32_t transactions = 0;
+    /// Pixel bytes sent to the panel.
+    uint32_t bytes = 0;
+};
+
+/**
+ * How well frames keep to the pace set by `te_pin` or `target_fps`.
+ */
+struct SlintPacingStats
+{
+    /// Frames flushed since start.
+    uint32_t frames = 0;
+    /// Frames whose last push was issued after their slot was over. In pipeline mode this is
+    /// measured on the flush task, so it includes the wait for TE and the pushes.
+    uint32_t missed_deadlines = 0;
+    /// Frame slots that passed without a new frame because rendering fell behind.
+    uint32_t skipped_slots = 0;
+    /// Frames per second over the last second of activity.
+    float fps = 0;
+};
+
+/**
+ * Refreshes of e-paper displays since start.
+ */
+struct SlintEpdStats
+{
+    /// Partial refreshes of the changed region.
+    uint32_t partial_refreshes = 0;
+    /// Full refreshes of the panel.
+    uint32_t full_refreshes = 0;
+    /// Redraws held back to batch them. A batch counts once, however many animation frames it
+    /// swallows.
+    uint32_t suppressed_frames = 0;
+};
+
+/**
+ * Update channel counters since start, see `slint_esp_channel_publish()`.
+ */
+struct SlintChannelStats
+{
+    /// Values stored by producers.
+    uint32_t published = 0;
+    /// Values handed to the handlers.
+    uint32_t applied = 0;
+    /// Values overwritten before the event loop applied them.
+    uint32_t coalesced = 0;
+    /// Values rejected: unknown key, too large, or more producers than
+    /// `SLINT_LGFX_CHANNEL_WRITERS` writing the key at once.
+    uint32_t dropped = 0;
+};
+
+/**
+ * One heap region, in bytes.
+ */
+struct SlintHeapStats
+{
+    uint32_t total = 0;
+    uint32_t free = 0;
+    /// Lowest free size since boot.
+    uint32_t min_free = 0;
+    /// Largest block that can be allocated now.
+    uint32_t largest_block = 0;
+    /// Lowest free size seen right after rendering or flushing a frame.
+    uint32_t frame_min_free = 0;
+};
+
+/**
+ * Stack and heap usage, to size the Slint task and the buffers. Sizes are in bytes.
+ */
+struct SlintMemoryStats
+{
+    /// Smallest amount of stack the event loop task has had left. 0 when unknown.
+    uint32_t slint_stack_free_min = 0;
+    /// The same for the flush task in pipeline mode.
+    uint32_t flush_stack_free_min = 0;
+    SlintHeapStats internal;
+    /// All zero without PSRAM.
+    SlintHeapStats psram;
+};
+
+/**
+ * State of the arena reserved with `arena_size`, in bytes.
+ */
+struct SlintArenaStats
+{
+    uint32_t size = 0;
+    uint32_t free = 0;
+    /// Lowest free size since start.
+    uint32_t min_free = 0;
+    uint32_t largest_block = 0;
+    uint32_t allocated_blocks = 0;
+    uint32_t free_blocks = 0;
+    /// Share of the free memory outside the largest free block.
+    uint32_t fragmentation_percent = 0;
+    /// Allocations that did not fit and went to the system heap.
+    uint32_t overflows = 0;
+};
+
+/**
+ * Mirror stream counters since start, see `slint_esp_mirror_start()`.
+ */
+struct SlintMirrorStats
+{
+    /// Frames sent completely.
+    uint32_t frames = 0;
+    /// Frames not sent because the bandwidth budget was spent or the mirror task was busy.
+    uint32_t skipped = 0;
+    /// Frames cut short because the sink did not take all bytes.
+    uint32_t truncated = 0;
+    uint32_t rectangles = 0;
+    /// Pixel bytes of the mirrored rectangles, and bytes of the encoded stream.
+    uint32_t raw_bytes = 0;
+    uint32_t encoded_bytes = 0;
+};
+
+/**
+ * Touch-to-photon latency: from the sample of a pointer event to the first push of the frame
+ * rendered after it. When several events wait for the same frame, the oldest one is measured.
+ */
+struct SlintLatencyStats
+{
+    static constexpr uint32_t buckets = 16;
+
+    uint32_t samples = 0;
+    uint32_t min_us = 0;
+    uint32_t avg_us = 0;
+    /// Percentiles, to the upper bound of the histogram bucket they fall in.
+    uint32_t p50_us = 0;
+    uint32_t p90_us = 0;
+    uint32_t p99_us = 0;
+    uint32_t max_us = 0;
+    /// Bucket 0 counts latencies below 1 ms, bucket i those below 2^i ms, the last one the rest.
+    uint32_t histogram[buckets] = {};
+};
+
+/**
+ * Touch input counters of all displays since start.
+ */
+struct SlintInputStats
+{
+    /// Touch controller reads.
+    uint32_t samples = 0;
+    /// Pointer events sent to windows.
+    uint32_t events = 0;
+    /// Contacts shorter than `debounce_ms`.
+    uint32_t bounces = 0;
+    /// Moves dropped within `jitter_radius`.
+    uint32_t jitter = 0;
+    /// Moves replaced by a later one before the frame.
+    uint32_t coalesced = 0;
+    /// Events after which the window did not need a redraw, so no latency was measured.
+    uint32_t no_effect = 0;
+    SlintLatencyStats latency;
+};
+
+/**
+ * Use of the bus arbitrated with `bus_slice_us`, since start. Times are in microseconds.
+ */
+struct SlintBusStats
+{
+    /// Time the displays held the bus, in total and at most in one go.
+    uint64_t display_hold_us = 0;
+    uint32_t display_max_hold_us = 0;
+    /// Time the displays waited for other users.
+    uint64_t display_wait_us = 0;
+    uint32_t display_max_wait_us = 0;
+    /// Times a display handed the bus over in the middle of a frame.
+    uint32_t yields = 0;
+    /// Successful `slint_esp_bus_acquire()` calls, and the time their callers held and waited.
+    uint32_t other_acquires = 0;
+    uint64_t other_hold_us = 0;
+    uint64_t other_wait_us = 0;
+    uint32_t other_max_wait_us = 0;
+    /// `slint_esp_bus_acquire()` calls that timed out.
+    uint32_t timeouts = 0;
+};
+
+/**
+ * Distribution of one per-frame figure over the recorded frames.
+ */
+struct SlintProfileStat
+{
+    uint32_t min = 0;
+    uint32_t avg = 0;
+    uint32_t p99 = 0;
+    uint32_t max = 0;
+};
+
+/**
+ * Hot-path figures of the last `SLINT_LGFX_PROFILE_FRAMES` (default 64) frames. Only filled in
+ * when the library is built with `-DSLINT_LGFX_PROFILE`.
+ */
+struct SlintProfileSummary
+{
+    /// Number of frames the figures are computed from.
+    uint32_t frames = 0;
+    /// Time spent in `update_timers_and_animations`.
+    SlintProfileStat timers_us;
+    /// Time spent in the software renderer.
+    SlintProfileStat render_us;
+    /// Time spent in byte swapping and pixel format conversion.
+    SlintProfileStat convert_us;
+    /// Time spent pushing to the panel, including waits for DMA.
+    SlintProfileStat push_us;
+    /// Time the event loop slept before the frame.
+    SlintProfileStat idle_us;
+    /// Dirty rectangles (or bands), pixels and bytes per frame.
+    SlintProfileStat rectangles;
+    SlintProfileStat pixels;
+    SlintProfileStat bytes;
+};
+
 /**
  * Initialize the Slint platform for LovyanGFX.
  *
@@ -39,3 +477,99 @@ SlintPlatformConfiguration(Args...) -> SlintPlatformConfiguration<>;
  */
 void slint_esp_init(const SlintPlatformConfiguration<slint::platform::Rgb565Pixel> &config);
 void slint_esp_init(const SlintPlatformConfiguration<slint::Rgb8Pixel> &config);
+
+/**
+ * Adds a display to the platform initialized by `slint_esp_init()`, with the same pixel type.
+ *
+ * Windows are bound to displays in the order they are created: the first to the display of
+ * `slint_esp_init()`, the next ones to the added displays. Only windows that need a redraw are
+ * rendered. Displays on different buses are flushed concurrently: the DMA transfer of one display
+ * keeps running while the next one renders.
+ */
+bool slint_esp_add_display(const SlintDisplayConfiguration<slint::platform::Rgb565Pixel> &config);
+bool slint_esp_add_display(const SlintDisplayConfiguration<slint::Rgb8Pixel> &config);
+
+/// Returns the flush statistics of the last completed frame.
+SlintFlushStats slint_esp_flush_stats();
+
+/// Returns the frame pacing statistics.
+SlintPacingStats slint_esp_pacing_stats();
+
+/// Returns the refresh counts of e-paper displays.
+SlintEpdStats slint_esp_epd_stats();
+
+/// Runs `fn(arg)` on the Slint task. Unlike `slint::invoke_from_event_loop()` nothing is allocated.
+/// Returns false if the platform is not initialized or the task was dropped because the queue was
+/// full (see `task_queue_full`).
+bool slint_esp_post(void (*fn)(void *), void *arg);
+
+/// Same as `slint_esp_post()`, callable from an ISR. Never blocks; drops when the queue is full.
+bool slint_esp_post_from_isr(void (*fn)(void *), void *arg);
+
+/// Number of posted tasks dropped because the queue was full.
+uint32_t slint_esp_dropped_tasks();
+
+/// Sets the function that applies the values published for `key`, from 0 to
+/// `SLINT_LGFX_CHANNEL_KEYS - 1` (32 keys by default). It runs on the Slint task, right before
+/// rendering, with the latest value published since the last frame.
+bool slint_esp_channel_handler(uint32_t key, void (*apply)(const void *value, void *arg), void *arg);
+
+/// Publishes a value of up to `SLINT_LGFX_CHANNEL_VALUE_SIZE` (default 16) bytes for `key`,
+/// replacing one that was not applied yet. When producers publish the same key concurrently, the
+/// one that started last wins. Never blocks or allocates, and can be called from tasks and ISRs. Only the first key changed since the last frame wakes the event loop.
+bool slint_esp_channel_publish(uint32_t key, const void *value, std::size_t size);
+
+template <typename T>
+bool slint_esp_channel_publish(uint32_t key, const T &value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    return slint_esp_channel_publish(key, &value, sizeof(T));
+}
+
+/// Returns the update channel counters.
+SlintChannelStats slint_esp_channel_stats();
+
+/// Returns the touch input counters and the touch-to-photon latency histogram.
+SlintInputStats slint_esp_input_stats();
+
+/// Takes the bus shared with the display, see `bus_slice_us`. Waiters get the bus in order of
+/// `priority`, then of arrival; the display hands it over between pushes. Returns false if the
+/// bus was not free within `timeout_ms`. Returns true right away when `bus_slice_us` is 0. Must
+/// not be called from the Slint task, which may be holding the bus.
+bool slint_esp_bus_acquire(uint32_t priority, uint32_t timeout_ms = UINT32_MAX);
+
+/// Gives back the bus taken with `slint_esp_bus_acquire()`.
+void slint_esp_bus_release();
+
+/// Returns the bus hold and wait times.
+SlintBusStats slint_esp_bus_stats();
+
+/// Mirrors what the first display shows to `write(data, size, arg)`, which returns the number
+/// of bytes it took: the pushed rectangles of each frame, run-length encoded (the format is
+/// described in `src/slint-lgfx-mirror.h`, `host/mirror_decode.py` decodes it). `write` is called
+/// from a low-priority mirror task, never from the render or flush task. Frames are skipped while
+/// that task still sends an earlier one or the stream exceeds `bytes_per_second` (0 for no
+/// limit), and a frame of the whole screen follows to resynchronize. Needs a frame buffer
+/// (`buffer1` or `buffer_placement`) and memory for a copy of one frame.
+void slint_esp_mirror_start(std::size_t (*write)(const void *data, std::size_t size, void *arg),
+                            void *arg, uint32_t bytes_per_second);
+
+/// Stops the mirror stream after the current frame.
+void slint_esp_mirror_stop();
+
+/// Returns the mirror stream counters.
+SlintMirrorStats slint_esp_mirror_stats();
+
+/// Returns stack high-water marks and heap usage.
+SlintMemoryStats slint_esp_memory_stats();
+
+/// Returns the state of the arena; all zero without one.
+SlintArenaStats slint_esp_arena_stats();
+
+/// Returns min/avg/p99/max hot-path figures. Empty unless built with `-DSLINT_LGFX_PROFILE`.
+SlintProfileSummary slint_esp_profile_summary();
+
+/// Prints one line of `slint_esp_memory_stats()` to the console, preceded by a one-line summary
+/// of `slint_esp_profile_summary()` when built with `-DSLINT_LGFX_PROFILE`. With profiling
+/// enabled this also happens every `SLINT_LGFX_PROFILE_DUMP_MS` (default 5000, 0 to disable).
+void slint_esp_profile_dump();
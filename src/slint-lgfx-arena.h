@@ -0,0 +1,187 @@
+// Dedicated heap for the Slint runtime and the library's buffers. It is reserved once at start, so
+// their allocations cannot fragment the system heap, nor the other way round.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "slint-lgfx.h"
+#include "esp_heap_caps.h"
+#include "multi_heap.h"
+#include "freertos/FreeRTOS.h"
+
+class Arena
+{
+public:
+    /// Reserves `size` bytes in `placement` and lays a heap over them.
+    bool begin(std::size_t size, SlintBufferPlacement placement)
+    {
+        auto caps = placement == SlintBufferPlacement::Psram
+                        ? MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT
+                        : MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT;
+        auto start = static_cast<uint8_t *>(heap_caps_malloc(size, caps));
+        if (!start)
+            return false;
+        m_heap = multi_heap_register(start, size);
+        if (!m_heap)
+        {
+            heap_caps_free(start);
+            return false;
+        }
+        multi_heap_set_lock(m_heap, &m_lock);
+        m_start = start;
+        m_end = start + size;
+        m_size = size;
+        m_caps = caps;
+        return true;
+    }
+
+    /// Whether memory from the arena has all of `caps`. `MALLOC_CAP_DEFAULT` (what malloc()
+    /// returns) is served from any arena.
+    bool serves(uint32_t caps) const
+    {
+        return m_heap && (caps & ~(m_caps | MALLOC_CAP_DEFAULT)) == 0;
+    }
+    bool owns(const void *p) const { return p >= m_start && p < m_end; }
+
+    /// Allocates from the arena when it has `caps`, otherwise or when it is full from the system
+    /// heap.
+    ///
+    /// Blocks come from multi_heap_malloc()/heap_caps_malloc() only, also when aligned: until
+    /// ESP-IDF 5, aligned blocks must be freed with the matching *_aligned_free(), which free()
+    /// cannot tell apart. The word before each block holds its offset from the start of the
+    /// underlying allocation, which is 8 unless it was aligned by hand, and the word before that
+    /// a tag derived from the block's address (see ours()). Aligned blocks also keep their size
+    /// in the word before the tag, for resize().
+    void *alloc(std::size_t size, std::size_t align, uint32_t caps)
+    {
+        bool aligned = align > header;
+        auto raw_size = size + (aligned ? align + header + word : header);
+        if (serves(caps))
+        {
+            if (auto raw = multi_heap_malloc(m_heap, raw_size))
+                return place(raw, size, align);
+            if (!size)
+                return nullptr;
+            m_overflows.fetch_add(1, std::memory_order_relaxed);
+        }
+        auto raw = heap_caps_malloc(raw_size, caps);
+        return raw ? place(raw, size, align) : nullptr;
+    }
+
+    /// Whether `p` came from alloc() or resize(). The renamed free() and realloc() in the Slint
+    /// runtime also get blocks that newlib or ESP-IDF allocated with the system malloc(), for
+    /// which release() and resize() fall back to heap_caps_free() and heap_caps_realloc(). For
+    /// those the tag word lies in the system heap's own block header, which would have to hold
+    /// exactly the tag of the address after it to be taken for ours.
+    static bool ours(const void *p) { return static_cast<const uint32_t *>(p)[-2] == tag(p); }
+
+    void release(void *p)
+    {
+        if (!ours(p))
+        {
+            heap_caps_free(p);
+            return;
+        }
+        auto raw = start_of(p);
+        // A stale pointer to the freed block must not pass for one of ours.
+        static_cast<uint32_t *>(p)[-2] = 0;
+        if (owns(raw))
+            multi_heap_free(m_heap, raw);
+        else
+            heap_caps_free(raw);
+    }
+
+    void *resize(void *p, std::size_t size, uint32_t caps)
+    {
+        if (!p)
+            return alloc(size, header, caps);
+        if (!ours(p))
+            return heap_caps_realloc(p, size, caps);
+        auto raw = start_of(p);
+        bool in_arena = owns(raw);
+        if (offset_of(p) == header)
+        {
+            // The header moves with the contents; only the tag depends on where.
+            auto q = in_arena ? multi_heap_realloc(m_heap, raw, size + header)
+                              : heap_caps_realloc(raw, size + header, caps);
+            if (q)
+                return place(q, size, header);
+            if (!in_arena)
+                return nullptr;
+        }
+        // Aligned blocks are moved, and so are blocks the arena has no room for (alloc() then
+        // takes the system heap).
+        auto q = alloc(size, header, caps);
+        if (q)
+        {
+            std::memcpy(q, p, std::min(size, size_of(p)));
+            release(p);
+        }
+        return q;
+    }
+
+    SlintArenaStats stats() const
+    {
+        SlintArenaStats out;
+        if (!m_heap)
+            return out;
+        multi_heap_info_t info;
+        multi_heap_get_info(m_heap, &info);
+        out.size = m_size;
+        out.free = info.total_free_bytes;
+        out.min_free = info.minimum_free_bytes;
+        out.largest_block = info.largest_free_block;
+        out.allocated_blocks = info.allocated_blocks;
+        out.free_blocks = info.free_blocks;
+        out.fragmentation_percent =
+            out.free ? 100 - uint32_t(uint64_t(out.largest_block) * 100 / out.free) : 0;
+        out.overflows = m_overflows.load();
+        return out;
+    }
+
+private:
+    static constexpr std::size_t word = sizeof(uint32_t);
+    /// Tag and offset.
+    static constexpr std::size_t header = 2 * word;
+
+    static uint32_t tag(const void *p)
+    {
+        return 0x534C4152u ^ uint32_t(reinterpret_cast<uintptr_t>(p));
+    }
+
+    /// Puts a block of `size` bytes aligned to `align` into `raw`, after its header.
+    static void *place(void *raw, std::size_t size, std::size_t align)
+    {
+        auto start = reinterpret_cast<uintptr_t>(raw);
+        auto p = start + header;
+        if (align > header)
+        {
+            p = (start + header + word + align - 1) & ~uintptr_t(align - 1);
+            reinterpret_cast<uint32_t *>(p)[-3] = uint32_t(size);
+        }
+        reinterpret_cast<uint32_t *>(p)[-1] = uint32_t(p - start);
+        reinterpret_cast<uint32_t *>(p)[-2] = tag(reinterpret_cast<void *>(p));
+        return reinterpret_cast<void *>(p);
+    }
+    static uint32_t offset_of(const void *p) { return static_cast<const uint32_t *>(p)[-1]; }
+    static void *start_of(void *p) { return static_cast<uint8_t *>(p) - offset_of(p); }
+    /// Usable size of a block; only aligned blocks record it.
+    std::size_t size_of(void *p) const
+    {
+        if (offset_of(p) != header)
+            return static_cast<const uint32_t *>(p)[-3];
+        auto raw = start_of(p);
+        return owns(raw) ? multi_heap_get_allocated_size(m_heap, raw) - header : 0;
+    }
+
+    multi_heap_handle_t m_heap = nullptr;
+    portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+    const uint8_t *m_start = nullptr;
+    const uint8_t *m_end = nullptr;
+    std::size_t m_size = 0;
+    uint32_t m_caps = 0;
+    std::atomic<uint32_t> m_overflows{0};
+};
@@ -0,0 +1,207 @@
+// Arbitration of a bus that the display shares with other devices, such as an SD card. The
+// display takes the bus per push transaction rather than per frame and hands it over between
+// pushes, so other users wait for one push instead of a whole frame.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include "slint-lgfx.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#ifndef SLINT_LGFX_BUS_WAITERS
+#define SLINT_LGFX_BUS_WAITERS 8
+#endif
+
+class BusArbiter
+{
+public:
+    /// Enables arbitration; until then acquire() always succeeds without blocking.
+    void begin(uint32_t slice_us, uint32_t display_priority)
+    {
+        for (auto &slot : m_slots)
+        {
+            slot.granted = xSemaphoreCreateBinary();
+        }
+        m_slice_us = slice_us;
+        m_display_priority = display_priority;
+        m_enabled = true;
+    }
+
+    bool enabled() const { return m_enabled; }
+
+    /// Waits for the bus. The longest waiting user of the highest priority gets it next.
+    bool acquire(uint32_t priority, TickType_t timeout, bool display)
+    {
+        if (!m_enabled)
+            return true;
+        auto start = esp_timer_get_time();
+        portENTER_CRITICAL(&m_lock);
+        if (!m_busy)
+        {
+            m_busy = true;
+            hold(display, start);
+            count_wait(display, 0);
+            portEXIT_CRITICAL(&m_lock);
+            return true;
+        }
+        auto slot = std::find_if(m_slots.begin(), m_slots.end(),
+                                 [](const Slot &s) { return !s.in_use; });
+        if (slot == m_slots.end() || !timeout)
+        {
+            m_stats.timeouts++;
+            portEXIT_CRITICAL(&m_lock);
+            return false;
+        }
+        slot->in_use = true;
+        slot->waiting = true;
+        slot->display = display;
+        slot->priority = priority;
+        slot->ticket = m_next_ticket++;
+        portEXIT_CRITICAL(&m_lock);
+
+        bool granted = xSemaphoreTake(slot->granted, timeout) == pdTRUE;
+        portENTER_CRITICAL(&m_lock);
+        if (!granted && slot->waiting)
+        {
+            slot->waiting = false;
+            slot->in_use = false;
+            m_stats.timeouts++;
+            portEXIT_CRITICAL(&m_lock);
+            return false;
+        }
+        portEXIT_CRITICAL(&m_lock);
+        if (!granted)
+        {
+            // Handed over right after the timeout: the give follows release() leaving its
+            // critical section, so wait for it rather than leave a stale token behind.
+            xSemaphoreTake(slot->granted, portMAX_DELAY);
+        }
+        portENTER_CRITICAL(&m_lock);
+        // Only now may another waiter reuse the slot and its semaphore.
+        slot->in_use = false;
+        count_wait(display, esp_timer_get_time() - start);
+        portEXIT_CRITICAL(&m_lock);
+        return true;
+    }
+
+    /// Hands the bus to the next waiter, or frees it.
+    void release(bool display)
+    {
+        if (!m_enabled)
+            return;
+        auto now = esp_timer_get_time();
+        Slot *next = nullptr;
+        portENTER_CRITICAL(&m_lock);
+        auto held = uint32_t(now - m_held_since);
+        if (display)
+        {
+            m_stats.display_hold_us += held;
+            m_stats.display_max_hold_us = std::max(m_stats.display_max_hold_us, held);
+        }
+        else
+        {
+            m_stats.other_hold_us += held;
+        }
+        for (auto &slot : m_slots)
+        {
+            if (slot.waiting && (!next || slot.priority > next->priority ||
+                                 (slot.priority == next->priority && slot.ticket < next->ticket)))
+                next = &slot;
+        }
+        if (next)
+        {
+            next->waiting = false;
+            hold(next->display, now);
+        }
+        else
+        {
+            m_busy = false;
+        }
+        portEXIT_CRITICAL(&m_lock);
+        if (next)
+            xSemaphoreGive(next->granted);
+    }
+
+    /// Whether the display, holding the bus since `held_since`, should hand it over before its
+    /// next push: a waiter outranks it, or its slice is used up and anyone is waiting.
+    bool should_yield(int64_t held_since, int64_t now)
+    {
+        bool expired = now - held_since >= m_slice_us;
+        bool yield = false;
+        portENTER_CRITICAL(&m_lock);
+        for (auto &slot : m_slots)
+        {
+            if (slot.waiting && !slot.display && (expired || slot.priority > m_display_priority))
+                yield = true;
+        }
+        portEXIT_CRITICAL(&m_lock);
+        return yield;
+    }
+
+    /// Called by the display when it hands the bus over in the middle of a frame.
+    void count_yield()
+    {
+        portENTER_CRITICAL(&m_lock);
+        m_stats.yields++;
+        portEXIT_CRITICAL(&m_lock);
+    }
+
+    uint32_t display_priority() const { return m_display_priority; }
+
+    SlintBusStats stats()
+    {
+        portENTER_CRITICAL(&m_lock);
+        auto out = m_stats;
+        portEXIT_CRITICAL(&m_lock);
+        return out;
+    }
+
+private:
+    struct Slot
+    {
+        SemaphoreHandle_t granted = nullptr;
+        /// Reserved from acquire() until its waiter has taken the grant or timed out.
+        bool in_use = false;
+        /// Queued for the bus; cleared by release() when it hands the bus over.
+        bool waiting = false;
+        bool display = false;
+        uint32_t priority = 0;
+        uint32_t ticket = 0;
+    };
+
+    // Called with the lock held.
+    void hold(bool display, int64_t now)
+    {
+        m_held_since = now;
+        if (!display)
+            m_stats.other_acquires++;
+    }
+    void count_wait(bool display, int64_t waited)
+    {
+        auto us = uint32_t(waited);
+        if (display)
+        {
+            m_stats.display_wait_us += us;
+            m_stats.display_max_wait_us = std::max(m_stats.display_max_wait_us, us);
+        }
+        else
+        {
+            m_stats.other_wait_us += us;
+            m_stats.other_max_wait_us = std::max(m_stats.other_max_wait_us, us);
+        }
+    }
+
+    bool m_enabled = false;
+    int64_t m_slice_us = 0;
+    uint32_t m_display_priority = 0;
+
+    portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+    bool m_busy = false;
+    int64_t m_held_since = 0;
+    uint32_t m_next_ticket = 0;
+    std::array<Slot, SLINT_LGFX_BUS_WAITERS> m_slots;
+    SlintBusStats m_stats;
+};
@@ -0,0 +1,190 @@
+// Keyed, latest-value-wins update channel: producers publish values per key without blocking,
+// and the event loop applies the latest value of each changed key once per frame.
+//
+// Each key is triple buffered, with one back buffer per concurrent producer: the event loop owns
+// the front buffer, the middle one holds the value waiting to be applied, and a producer copies
+// into a free back buffer and then swaps it into the middle. Publishes are ordered by a ticket
+// taken when they start, and a value only replaces the middle one if its ticket is newer, so a
+// producer interrupted by a later publish (an ISR, a higher priority task) cannot overwrite it.
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "slint-lgfx.h"
+#include "esp_attr.h"
+
+#ifndef SLINT_LGFX_CHANNEL_KEYS
+#define SLINT_LGFX_CHANNEL_KEYS 32
+#endif
+
+#ifndef SLINT_LGFX_CHANNEL_VALUE_SIZE
+#define SLINT_LGFX_CHANNEL_VALUE_SIZE 16
+#endif
+
+/// Producers that may write the same key at once, such as a task and an ISR.
+#ifndef SLINT_LGFX_CHANNEL_WRITERS
+#define SLINT_LGFX_CHANNEL_WRITERS 2
+#endif
+
+static_assert(SLINT_LGFX_CHANNEL_KEYS <= 32, "the dirty set is a 32-bit mask");
+static_assert(SLINT_LGFX_CHANNEL_WRITERS >= 1 && SLINT_LGFX_CHANNEL_WRITERS <= 6,
+              "buffer indices are 3 bits");
+
+class UpdateChannel
+{
+public:
+    enum class Published
+    {
+        /// First changed key since the last drain: the event loop needs a wakeup.
+        First,
+        /// Another key was already waiting, so the event loop is awake or about to be.
+        Queued,
+        /// Replaced a value of this key that was not applied yet.
+        Coalesced,
+        /// Unknown key, value too large, or `SLINT_LGFX_CHANNEL_WRITERS` producers were already
+        /// writing the same key.
+        Dropped,
+    };
+
+    bool set_handler(uint32_t key, void (*apply)(const void *, void *), void *arg)
+    {
+        if (key >= m_slots.size())
+            return false;
+        m_slots[key].arg = arg;
+        m_slots[key].apply.store(apply, std::memory_order_release);
+        return true;
+    }
+
+    Published IRAM_ATTR publish(uint32_t key, const void *value, std::size_t size)
+    {
+        if (key >= m_slots.size() || size > SLINT_LGFX_CHANNEL_VALUE_SIZE ||
+            !m_slots[key].apply.load(std::memory_order_acquire))
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return Published::Dropped;
+        }
+
+        auto &slot = m_slots[key];
+        uint32_t ticket = slot.ticket.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        // Take a back buffer. Each one is held by a producer that is still copying.
+        uint32_t free = slot.free.load(std::memory_order_relaxed);
+        uint32_t bit;
+        do
+        {
+            if (!free)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return Published::Dropped;
+            }
+            bit = free & -free;
+        } while (!slot.free.compare_exchange_weak(free, free & ~bit, std::memory_order_acquire,
+                                                  std::memory_order_relaxed));
+        auto index = uint32_t(__builtin_ctz(bit));
+        std::memcpy(slot.values[index], value, size);
+        m_published.fetch_add(1, std::memory_order_relaxed);
+
+        // Swap it into the middle, unless a newer value got there (or was applied) first.
+        uint32_t mine = ticket << ticket_shift | fresh | index;
+        uint32_t middle = slot.middle.load(std::memory_order_relaxed);
+        do
+        {
+            if (newer(middle, mine))
+            {
+                slot.free.fetch_or(bit, std::memory_order_release);
+                m_coalesced.fetch_add(1, std::memory_order_relaxed);
+                return Published::Coalesced;
+            }
+        } while (!slot.middle.compare_exchange_weak(middle, mine, std::memory_order_acq_rel,
+                                                    std::memory_order_relaxed));
+        slot.free.fetch_or(1u << (middle & index_mask), std::memory_order_release);
+
+        auto key_bit = uint32_t(1) << key;
+        auto dirty = m_dirty.fetch_or(key_bit, std::memory_order_acq_rel);
+        if (middle & fresh)
+        {
+            m_coalesced.fetch_add(1, std::memory_order_relaxed);
+            return Published::Coalesced;
+        }
+        return dirty ? Published::Queued : Published::First;
+    }
+
+    /// Applies the latest value of every key published since the last drain. Called on the
+    /// Slint task.
+    void drain()
+    {
+        auto dirty = m_dirty.exchange(0, std::memory_order_acq_rel);
+        while (dirty)
+        {
+            auto key = uint32_t(__builtin_ctz(dirty));
+            dirty &= dirty - 1;
+            auto &slot = m_slots[key];
+
+            // Take the middle buffer and leave the front one in its place. The middle keeps the
+            // ticket of the value taken, so that older values still being copied are discarded.
+            uint32_t middle = slot.middle.load(std::memory_order_relaxed);
+            bool taken = false;
+            while (middle & fresh)
+            {
+                uint32_t back = (middle & ticket_mask) | slot.front;
+                if (slot.middle.compare_exchange_weak(middle, back, std::memory_order_acq_rel,
+                                                      std::memory_order_relaxed))
+                {
+                    taken = true;
+                    break;
+                }
+            }
+            // Nothing new: the value marked dirty was applied in an earlier drain.
+            if (!taken)
+                continue;
+            slot.front = middle & index_mask;
+            slot.apply.load(std::memory_order_relaxed)(slot.values[slot.front], slot.arg);
+            m_applied++;
+        }
+    }
+
+    SlintChannelStats stats() const
+    {
+        return {m_published.load(), m_applied.load(), m_coalesced.load(), m_dropped.load()};
+    }
+
+private:
+    // The middle word: the ticket of the value in the middle buffer, whether it is waiting to be
+    // applied, and the buffer index.
+    static constexpr uint32_t index_mask = 0x7;
+    static constexpr uint32_t fresh = 0x8;
+    static constexpr uint32_t ticket_shift = 4;
+    static constexpr uint32_t ticket_mask = ~uint32_t(0) << ticket_shift;
+
+    /// Whether the ticket of `a` is later than that of `b`, across wrap-around.
+    static bool newer(uint32_t a, uint32_t b)
+    {
+        return int32_t((a & ticket_mask) - (b & ticket_mask)) > 0;
+    }
+
+    static constexpr uint32_t buffers = SLINT_LGFX_CHANNEL_WRITERS + 2;
+
+    struct Slot
+    {
+        std::atomic<uint32_t> ticket{0};
+        /// Buffer 0 starts as the front and buffer 1 as the middle; the rest are back buffers.
+        std::atomic<uint32_t> middle{1};
+        std::atomic<uint32_t> free{((1u << buffers) - 1) & ~3u};
+        /// Only touched by the Slint task.
+        uint32_t front = 0;
+        std::atomic<void (*)(const void *, void *)> apply{nullptr};
+        void *arg = nullptr;
+        alignas(4) uint8_t values[buffers][SLINT_LGFX_CHANNEL_VALUE_SIZE];
+    };
+
+    std::array<Slot, SLINT_LGFX_CHANNEL_KEYS> m_slots{};
+    std::atomic<uint32_t> m_dirty{0};
+
+    std::atomic<uint32_t> m_published{0};
+    std::atomic<uint32_t> m_applied{0};
+    std::atomic<uint32_t> m_coalesced{0};
+    std::atomic<uint32_t> m_dropped{0};
+};
@@ -0,0 +1,219 @@
+// Pixel format conversion kernels used between rendering and pushing to the panel.
+//
+// All kernels work on raw bytes and accept `dst == src`. Kernels whose output is smaller than
+// their input may also run with `dst` lagging behind `src` in the same buffer, which is how bands
+// are packed in place.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace convert
+{
+    /// One kernel instantiation, picked once per display for its format and byte order. `x` and
+    /// `y` are the panel coordinates of the first pixel, which only dithering kernels use.
+    using kernel_t = void (*)(const uint8_t *src, uint8_t *dst, std::size_t n, int32_t x,
+                              int32_t y);
+
+    /// A kernel_t for a kernel that does not depend on the pixel position.
+    template <void (*Kernel)(const uint8_t *, uint8_t *, std::size_t)>
+    inline void anywhere(const uint8_t *src, uint8_t *dst, std::size_t n, int32_t, int32_t)
+    {
+        Kernel(src, dst, n);
+    }
+
+    using word_t = uint32_t __attribute__((__may_alias__));
+    using half_t = uint16_t __attribute__((__may_alias__));
+
+    inline bool word_aligned(const void *p) { return (reinterpret_cast<uintptr_t>(p) & 3) == 0; }
+
+    /// Swaps the bytes of `n` RGB565 pixels from `src` into `dst`, two pixels per 32-bit word
+    /// when both are equally aligned.
+    inline void swap_rgb565(const uint8_t *src, uint8_t *dst, std::size_t n)
+    {
+        auto in = reinterpret_cast<const half_t *>(src);
+        auto out = reinterpret_cast<half_t *>(dst);
+        auto swap = [](uint16_t v) { return uint16_t(v << 8 | v >> 8); };
+        if (n && !word_aligned(out))
+        {
+            *out++ = swap(*in++);
+            n--;
+        }
+        if (word_aligned(in))
+        {
+            auto words_in = reinterpret_cast<const word_t *>(in);
+            auto words = reinterpret_cast<word_t *>(out);
+            std::size_t i = 0;
+            for (; i + 2 <= n / 2; i += 2)
+            {
+                auto a = words_in[i], b = words_in[i + 1];
+                words[i] = ((a & 0x00FF00FFu) << 8) | ((a >> 8) & 0x00FF00FFu);
+                words[i + 1] = ((b & 0x00FF00FFu) << 8) | ((b >> 8) & 0x00FF00FFu);
+            }
+            for (; i < n / 2; i++)
+            {
+                auto a = words_in[i];
+                words[i] = ((a & 0x00FF00FFu) << 8) | ((a >> 8) & 0x00FF00FFu);
+            }
+            in += n & ~std::size_t(1);
+            out += n & ~std::size_t(1);
+            n &= 1;
+        }
+        for (; n; n--)
+            *out++ = swap(*in++);
+    }
+
+    /// Copies `n` pixels of `Bytes` bytes, for panels that take the rendered format.
+    template <std::size_t Bytes>
+    inline void copy(const uint8_t *src, uint8_t *dst, std::size_t n)
+    {
+        if (dst != src)
+            std::memcpy(dst, src, n * Bytes);
+    }
+
+    /// Swaps the bytes of `n` RGB565 pixels in place.
+    inline void swap_rgb565(uint8_t *data, std::size_t n) { swap_rgb565(data, data, n); }
+
+    /// Converts `n` RGB888 pixels from `src` into `dst`, optionally swapping red and blue and
+    /// clearing the two low bits of each channel for 18-bit panels. Four pixels are handled per
+    /// three words when `src` and `dst` are equally aligned.
+    template <bool SwapRB, bool Mask666>
+    inline void rgb888_convert(const uint8_t *src, uint8_t *dst, std::size_t n)
+    {
+        constexpr uint8_t byte_mask = Mask666 ? 0xFC : 0xFF;
+        constexpr uint32_t word_mask = Mask666 ? 0xFCFCFCFCu : 0xFFFFFFFFu;
+
+        auto pixel = [&]
+        {
+            uint8_t r = src[0], g = src[1], b = src[2];
+            dst[0] = (SwapRB ? b : r) & byte_mask;
+            dst[1] = g & byte_mask;
+            dst[2] = (SwapRB ? r : b) & byte_mask;
+            src += 3;
+            dst += 3;
+        };
+        while (n && !word_aligned(dst))
+        {
+            pixel();
+            n--;
+        }
+        if (word_aligned(src))
+        {
+            auto words_in = reinterpret_cast<const word_t *>(src);
+            auto words = reinterpret_cast<word_t *>(dst);
+            for (; n >= 4; n -= 4, words_in += 3, words += 3)
+            {
+                auto w0 = words_in[0], w1 = words_in[1], w2 = words_in[2];
+                if (SwapRB)
+                {
+                    // Little-endian bytes: w0 = r0 g0 b0 r1, w1 = g1 b1 r2 g2, w2 = b2 r3 g3 b3.
+                    auto o0 = ((w0 >> 16) & 0xFFu) | (w0 & 0xFF00u) | ((w0 & 0xFFu) << 16) |
+                              (((w1 >> 8) & 0xFFu) << 24);
+                    auto o1 = (w1 & 0xFF0000FFu) | ((w0 >> 24) << 8) | ((w2 & 0xFFu) << 16);
+                    auto o2 = ((w1 >> 16) & 0xFFu) | ((w2 >> 24) << 8) | (w2 & 0xFF0000u) |
+                              (((w2 >> 8) & 0xFFu) << 24);
+                    w0 = o0;
+                    w1 = o1;
+                    w2 = o2;
+                }
+                words[0] = w0 & word_mask;
+                words[1] = w1 & word_mask;
+                words[2] = w2 & word_mask;
+            }
+            src = reinterpret_cast<const uint8_t *>(words_in);
+            dst = reinterpret_cast<uint8_t *>(words);
+        }
+        for (; n; n--)
+            pixel();
+    }
+
+    /// In-place form of rgb888_convert().
+    template <bool SwapRB, bool Mask666>
+    inline void rgb888_in_place(uint8_t *data, std::size_t n)
+    {
+        rgb888_convert<SwapRB, Mask666>(data, data, n);
+    }
+
+    inline uint16_t pack_rgb565(uint8_t r, uint8_t g, uint8_t b)
+    {
+        return uint16_t((r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3);
+    }
+
+    /// Packs `n` RGB888 pixels into big-endian RGB565, the order the panel expects on the wire.
+    /// Each pair of pixels is read before it is written, so `dst` may trail `src`.
+    template <bool SwapRB>
+    inline void rgb888_to_rgb565(const uint8_t *src, uint8_t *dst, std::size_t n)
+    {
+        auto pixel = [&]
+        {
+            auto v = SwapRB ? pack_rgb565(src[2], src[1], src[0])
+                            : pack_rgb565(src[0], src[1], src[2]);
+            src += 3;
+            return v;
+        };
+        if (n && !word_aligned(dst))
+        {
+            auto v = pixel();
+            dst[0] = v >> 8;
+            dst[1] = v & 0xFF;
+            dst += 2;
+            n--;
+        }
+        auto words = reinterpret_cast<word_t *>(dst);
+        for (; n >= 2; n -= 2)
+        {
+            uint32_t a = pixel();
+            uint32_t b = pixel();
+            *words++ = (a >> 8) | (a & 0xFF) << 8 | (b >> 8) << 16 | (b & 0xFF) << 24;
+        }
+        if (n)
+        {
+            dst = reinterpret_cast<uint8_t *>(words);
+            auto v = pixel();
+            dst[0] = v >> 8;
+            dst[1] = v & 0xFF;
+        }
+    }
+
+    /// 4x4 Bayer matrix, thresholds 0 to 15.
+    inline constexpr uint8_t bayer4[4][4] = {
+        {0, 8, 2, 10},
+        {12, 4, 14, 6},
+        {3, 11, 1, 9},
+        {15, 7, 13, 5},
+    };
+
+    /// Packs `n` pixels into RGB332 (`lgfx::rgb332_t`), with ordered dithering if `Dither`.
+    /// `InBytes` is 2 for native-endian RGB565 and 3 for RGB888 sources. Each pixel is read
+    /// before it is written, so `dst` may trail `src`.
+    template <std::size_t InBytes, bool Dither>
+    inline void to_rgb332(const uint8_t *src, uint8_t *dst, std::size_t n, int32_t x, int32_t y)
+    {
+        // A channel c of 8 bits becomes (c * levels / 255 + threshold) rounded down, in 16.16
+        // fixed point; without dithering the threshold is one half, which rounds to nearest.
+        uint32_t thresholds[4];
+        for (int i = 0; i < 4; i++)
+            thresholds[i] = Dither ? (bayer4[y & 3][(x + i) & 3] * 16 + 8) << 8 : 0x8000;
+        for (std::size_t i = 0; i < n; i++, src += InBytes)
+        {
+            uint32_t r, g, b;
+            if constexpr (InBytes == 2)
+            {
+                uint32_t v = src[0] | src[1] << 8;
+                r = v >> 11, g = (v >> 5) & 0x3F, b = v & 0x1F;
+                r = r << 3 | r >> 2;
+                g = g << 2 | g >> 4;
+                b = b << 3 | b >> 2;
+            }
+            else
+            {
+                r = src[0], g = src[1], b = src[2];
+            }
+            auto t = thresholds[i & 3];
+            dst[i] = uint8_t(((r * 1799 + t) >> 16) << 5 | ((g * 1799 + t) >> 16) << 2 |
+                             ((b * 771 + t) >> 16));
+        }
+    }
+}
@@ -0,0 +1,118 @@
+// E-paper refresh policy: pushes only update the controller's memory, and the panel is refreshed
+// once per batch of changes with a partial or full waveform.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <LovyanGFX.hpp>
+#include "slint-lgfx.h"
+
+/// Refresh counts shared by all e-paper displays.
+struct EpdCounters
+{
+    std::atomic<uint32_t> partial{0};
+    std::atomic<uint32_t> full{0};
+    std::atomic<uint32_t> suppressed{0};
+};
+
+class EpdRefresher
+{
+public:
+    void begin(const SlintEpdConfiguration &config, lgfx::LGFX_Device *gfx, EpdCounters &counters)
+    {
+        m_enabled = gfx && (config.mode == SlintEpdMode::On ||
+                            (config.mode == SlintEpdMode::Auto && gfx->isEPD()));
+        m_batch_us = int64_t(config.batch_ms) * 1000;
+        m_hold_us = std::max<int64_t>(int64_t(config.animation_hold_ms) * 1000, m_batch_us);
+        m_full_percent = config.full_refresh_percent;
+        m_partial_budget = config.partial_budget;
+        m_counters = &counters;
+        if (m_enabled)
+        {
+            // Pushes only write the controller's memory; refresh() shows them.
+            gfx->setAutoDisplay(false);
+        }
+    }
+
+    bool enabled() const { return m_enabled; }
+
+    /// Called while the window has changes that are not shown yet. Returns the microseconds
+    /// until they should be rendered, or 0 to render now. Changes are collected for the batch
+    /// window after the first one, and for up to `animation_hold_ms` while animations run, so
+    /// that intermediate animation frames are never refreshed.
+    int64_t until_due(int64_t now, bool animating)
+    {
+        bool started = !m_pending;
+        if (started)
+        {
+            m_pending = true;
+            m_first_change = now;
+        }
+        auto due = m_first_change + (animating ? m_hold_us : m_batch_us);
+        if (due <= now)
+        {
+            m_pending = false;
+            return 0;
+        }
+        // The event loop asks again on every pass until the batch is due; count the redraw once.
+        if (started)
+            m_counters->suppressed++;
+        // Look again after a batch window in case the animations have stopped.
+        return std::min(due - now, std::max<int64_t>(m_batch_us, 1000));
+    }
+
+    /// Records a region pushed to the controller.
+    void add_rect(int32_t x, int32_t y, int32_t w, int32_t h)
+    {
+        if (m_w == 0)
+        {
+            m_x = x, m_y = y, m_w = w, m_h = h;
+            return;
+        }
+        auto x1 = std::max(m_x + m_w, x + w), y1 = std::max(m_y + m_h, y + h);
+        m_x = std::min(m_x, x);
+        m_y = std::min(m_y, y);
+        m_w = x1 - m_x;
+        m_h = y1 - m_y;
+    }
+
+    /// Refreshes the pushed regions: a partial waveform on their bounding box while it is small
+    /// and the ghosting budget allows, otherwise a full refresh of the panel.
+    void refresh(lgfx::LGFX_Device *gfx)
+    {
+        if (m_w == 0)
+            return;
+        int64_t screen = int64_t(gfx->width()) * gfx->height();
+        bool full = int64_t(m_w) * m_h * 100 >= screen * m_full_percent ||
+                    m_partials >= m_partial_budget;
+        if (full)
+        {
+            gfx->setEpdMode(lgfx::epd_mode_t::epd_quality);
+            gfx->display(0, 0, gfx->width(), gfx->height());
+            m_partials = 0;
+            m_counters->full++;
+        }
+        else
+        {
+            gfx->setEpdMode(lgfx::epd_mode_t::epd_fast);
+            gfx->display(m_x, m_y, m_w, m_h);
+            m_partials++;
+            m_counters->partial++;
+        }
+        m_w = m_h = 0;
+    }
+
+private:
+    bool m_enabled = false;
+    int64_t m_batch_us = 0;
+    int64_t m_hold_us = 0;
+    uint32_t m_full_percent = 50;
+    uint32_t m_partial_budget = 10;
+    EpdCounters *m_counters = nullptr;
+
+    bool m_pending = false;
+    int64_t m_first_change = 0;
+    uint32_t m_partials = 0;
+    int32_t m_x = 0, m_y = 0, m_w = 0, m_h = 0;
+};
@@ -0,0 +1,22 @@
+// GPIO interrupt helper for panel and touch signals.
+#pragma once
+
+#include "driver/gpio.h"
+
+/// Configures `pin` as an input with pull-up and calls `handler(arg)` from an ISR on `edge`.
+inline bool attach_gpio_isr(int pin, gpio_int_type_t edge, gpio_isr_t handler, void *arg)
+{
+    gpio_config_t io = {};
+    io.pin_bit_mask = 1ULL << pin;
+    io.mode = GPIO_MODE_INPUT;
+    io.pull_up_en = GPIO_PULLUP_ENABLE;
+    io.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    io.intr_type = edge;
+    if (gpio_config(&io) != ESP_OK)
+        return false;
+    // The ISR service may already be installed, e.g. by Arduino's attachInterrupt().
+    auto err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+        return false;
+    return gpio_isr_handler_add(gpio_num_t(pin), handler, arg) == ESP_OK;
+}
@@ -0,0 +1,185 @@
+// Touch input: a filter between the controller samples and the pointer events sent to a window,
+// and touch-to-photon latency tracing.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include "slint-lgfx.h"
+
+/// A pointer event decided by the filter, with the time its contact was sampled.
+struct TouchEvent
+{
+    enum class Kind : uint8_t
+    {
+        None,
+        Press,
+        Move,
+        Release,
+    };
+
+    Kind kind = Kind::None;
+    int32_t x = 0, y = 0;
+    int64_t sampled_us = 0;
+};
+
+/// Counters shared by all displays. Latencies are recorded on the task that pushes.
+struct InputCounters
+{
+    std::atomic<uint32_t> samples{0};
+    std::atomic<uint32_t> events{0};
+    std::atomic<uint32_t> bounces{0};
+    std::atomic<uint32_t> jitter{0};
+    std::atomic<uint32_t> coalesced{0};
+    std::atomic<uint32_t> no_effect{0};
+
+    std::atomic<uint32_t> latency_samples{0};
+    std::atomic<uint64_t> latency_total_us{0};
+    std::atomic<uint32_t> latency_min_us{UINT32_MAX};
+    std::atomic<uint32_t> latency_max_us{0};
+    std::atomic<uint32_t> buckets[SlintLatencyStats::buckets] = {};
+
+    void record_latency(int64_t us)
+    {
+        auto v = uint32_t(std::clamp<int64_t>(us, 0, UINT32_MAX));
+        latency_samples.fetch_add(1, std::memory_order_relaxed);
+        latency_total_us.fetch_add(v, std::memory_order_relaxed);
+        auto min = latency_min_us.load(std::memory_order_relaxed);
+        while (v < min && !latency_min_us.compare_exchange_weak(min, v))
+        {
+        }
+        auto max = latency_max_us.load(std::memory_order_relaxed);
+        while (v > max && !latency_max_us.compare_exchange_weak(max, v))
+        {
+        }
+        buckets[bucket(v)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Bucket 0 holds latencies below 1 ms, bucket i those below 2^i ms, the last one the rest.
+    static std::size_t bucket(uint32_t us)
+    {
+        std::size_t i = 0;
+        for (uint32_t limit = 1000; i + 1 < SlintLatencyStats::buckets && us >= limit; limit *= 2)
+            i++;
+        return i;
+    }
+    static uint32_t bucket_limit_us(std::size_t i) { return 1000u << i; }
+
+    SlintInputStats stats() const
+    {
+        SlintInputStats out;
+        out.samples = samples.load();
+        out.events = events.load();
+        out.bounces = bounces.load();
+        out.jitter = jitter.load();
+        out.coalesced = coalesced.load();
+        out.no_effect = no_effect.load();
+        auto &l = out.latency;
+        l.samples = latency_samples.load();
+        if (!l.samples)
+            return out;
+        l.min_us = latency_min_us.load();
+        l.max_us = latency_max_us.load();
+        l.avg_us = uint32_t(latency_total_us.load() / l.samples);
+        for (std::size_t i = 0; i < SlintLatencyStats::buckets; i++)
+            l.histogram[i] = buckets[i].load();
+        l.p50_us = percentile(l, 50);
+        l.p90_us = percentile(l, 90);
+        l.p99_us = percentile(l, 99);
+        return out;
+    }
+
+private:
+    /// Upper bound of the bucket the percentile falls in, within the recorded range.
+    static uint32_t percentile(const SlintLatencyStats &l, uint32_t percent)
+    {
+        uint64_t wanted = (uint64_t(l.samples) * percent + 99) / 100, seen = 0;
+        for (std::size_t i = 0; i + 1 < SlintLatencyStats::buckets; i++)
+        {
+            seen += l.histogram[i];
+            if (seen >= wanted)
+                return std::clamp(bucket_limit_us(i), l.min_us, l.max_us);
+        }
+        return l.max_us;
+    }
+};
+
+/// Turns raw controller samples into press, move and release events. Runs on the Slint task.
+class TouchFilter
+{
+public:
+    void begin(const SlintTouchFilterConfiguration &config, InputCounters &counters)
+    {
+        m_debounce_us = int64_t(config.debounce_ms) * 1000;
+        m_jitter_sq = int64_t(config.jitter_radius) * config.jitter_radius;
+        m_counters = &counters;
+    }
+
+    /// Takes one sample, in physical UI coordinates.
+    TouchEvent sample(bool touched, int32_t x, int32_t y, int64_t now)
+    {
+        m_counters->samples++;
+        if (touched)
+        {
+            m_lost_at = 0;
+            if (!m_down)
+            {
+                // A press counts from the first sample of the contact, so that the debounce
+                // time shows up in the latency.
+                if (!m_contact_at)
+                    m_contact_at = now;
+                if (now - m_contact_at < m_debounce_us)
+                    return {};
+                m_down = true;
+                return report(TouchEvent::Kind::Press, x, y, m_contact_at);
+            }
+            int64_t dx = x - m_x, dy = y - m_y;
+            if (m_jitter_sq && dx * dx + dy * dy <= m_jitter_sq)
+            {
+                m_counters->jitter++;
+                return {};
+            }
+            return report(TouchEvent::Kind::Move, x, y, now);
+        }
+
+        if (!m_down)
+        {
+            if (m_contact_at)
+            {
+                // Released before the debounce time: a bounce.
+                m_counters->bounces++;
+                m_contact_at = 0;
+            }
+            return {};
+        }
+        // Short dropouts of a held contact do not release it.
+        if (!m_lost_at)
+            m_lost_at = now;
+        if (now - m_lost_at < m_debounce_us)
+            return {};
+        m_down = false;
+        m_contact_at = 0;
+        return report(TouchEvent::Kind::Release, m_x, m_y, m_lost_at);
+    }
+
+    /// Whether the pointer is down, or a press or release is being debounced. The controller
+    /// must be polled until this is false.
+    bool active() const { return m_down || m_contact_at; }
+
+private:
+    TouchEvent report(TouchEvent::Kind kind, int32_t x, int32_t y, int64_t at)
+    {
+        m_x = x;
+        m_y = y;
+        return {kind, x, y, at};
+    }
+
+    int64_t m_debounce_us = 0;
+    int64_t m_jitter_sq = 0;
+    InputCounters *m_counters = nullptr;
+
+    bool m_down = false;
+    int64_t m_contact_at = 0;
+    int64_t m_lost_at = 0;
+    int32_t m_x = 0, m_y = 0;
+};
@@ -0,0 +1,84 @@
+// Memory telemetry: stack high-water marks of the platform's tasks and heap figures, with the
+// lowest free heap seen right after rendering and flushing.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include "slint-lgfx.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+class MemoryMonitor
+{
+public:
+    TaskHandle_t slint_task = nullptr;
+    TaskHandle_t flush_task = nullptr;
+
+    /// Records the free heap at a peak of the frame: after rendering, and after flushing.
+    void sample()
+    {
+        lower(m_frame_internal_min, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+        lower(m_frame_psram_min, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    }
+
+    SlintMemoryStats stats() const
+    {
+        SlintMemoryStats out;
+        // ESP-IDF reports the high-water marks in bytes.
+        if (slint_task)
+            out.slint_stack_free_min = uxTaskGetStackHighWaterMark(slint_task);
+        if (flush_task)
+            out.flush_stack_free_min = uxTaskGetStackHighWaterMark(flush_task);
+
+        out.internal = heap(MALLOC_CAP_INTERNAL, m_frame_internal_min);
+        out.psram = heap(MALLOC_CAP_SPIRAM, m_frame_psram_min);
+        return out;
+    }
+
+    /// Prints stats() and the arena's state on one line.
+    void dump() const
+    {
+        auto m = stats();
+        auto heap = [](const char *name, const SlintHeapStats &h)
+        { printf(" %s %lu/%lu/%lu/%lu", name, (unsigned long)h.free, (unsigned long)h.frame_min_free,
+                 (unsigned long)h.min_free, (unsigned long)h.largest_block); };
+        printf("[slint] stack free min %lu (flush %lu), heap free/frame min/min/largest:",
+               (unsigned long)m.slint_stack_free_min, (unsigned long)m.flush_stack_free_min);
+        heap("internal", m.internal);
+        heap("psram", m.psram);
+        if (auto a = slint_esp_arena_stats(); a.size)
+        {
+            printf(" arena %lu/%lu/%lu %lu%% fragmented", (unsigned long)a.free,
+                   (unsigned long)a.min_free, (unsigned long)a.largest_block,
+                   (unsigned long)a.fragmentation_percent);
+        }
+        printf("\n");
+    }
+
+private:
+    static void lower(std::atomic<uint32_t> &min, uint32_t value)
+    {
+        auto current = min.load(std::memory_order_relaxed);
+        while (value < current && !min.compare_exchange_weak(current, value))
+        {
+        }
+    }
+
+    static SlintHeapStats heap(uint32_t caps, const std::atomic<uint32_t> &frame_min)
+    {
+        SlintHeapStats out;
+        out.total = heap_caps_get_total_size(caps);
+        out.free = heap_caps_get_free_size(caps);
+        out.min_free = heap_caps_get_minimum_free_size(caps);
+        out.largest_block = heap_caps_get_largest_free_block(caps);
+        auto frame = frame_min.load(std::memory_order_relaxed);
+        out.frame_min_free = frame == UINT32_MAX ? out.free : frame;
+        return out;
+    }
+
+    std::atomic<uint32_t> m_frame_internal_min{UINT32_MAX};
+    std::atomic<uint32_t> m_frame_psram_min{UINT32_MAX};
+};
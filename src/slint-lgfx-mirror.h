@@ -0,0 +1,372 @@
+// Mirror output: the dirty rectangles of each frame, run-length encoded into a delta stream for
+// a pluggable sink, throttled so that it never holds up the panel. The pushed rectangles are
+// copied into a snapshot after the push; a low-priority task encodes the snapshot and calls the
+// sink, so a slow sink only makes the mirror skip frames.
+//
+// Stream format, little-endian:
+//   frame start  "SLMF" u32 sequence, u16 width, u16 height, u8 pixel format, u8 flags (1 = key)
+//   rectangle    'R' u16 x, y, w, h, then each row run-length encoded: a count byte c, followed by
+//                one pixel repeated (c & 0x7F) + 1 times if c & 0x80, else by c + 1 literal pixels.
+//                Runs never cross rows.
+//   frame end    'E' u32 bytes of the frame before this marker
+// A key frame holds the whole screen. After a skipped or truncated frame the next one is a key
+// frame, so a decoder can resynchronize on the next "SLMF".
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "slint-lgfx.h"
+#include "slint-lgfx-arena.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/// Pixel layout of the mirrored rectangles, as it is in the frame buffer.
+enum class MirrorFormat : uint8_t
+{
+    Rgb565 = 0,
+    Rgb565Swapped = 1,
+    Rgb888 = 2,
+    Bgr888 = 3,
+};
+
+struct MirrorFrame
+{
+    uint16_t width;
+    uint16_t height;
+    MirrorFormat format;
+    bool key;
+};
+
+class MirrorStream
+{
+public:
+    using Write = std::size_t (*)(const void *data, std::size_t size, void *arg);
+
+    enum class Plan
+    {
+        Skip,
+        Delta,
+        Key,
+    };
+
+    explicit MirrorStream(Arena &arena) : m_arena(arena) {}
+
+    void start(Write write, void *arg, uint32_t bytes_per_second)
+    {
+        // The task may still be sending a frame of the previous start().
+        while (m_busy)
+            vTaskDelay(1);
+        m_write = write;
+        m_arg = arg;
+        m_rate = bytes_per_second;
+        m_tokens = burst();
+        m_last_refill = esp_timer_get_time();
+        m_need_key = true;
+        if (!m_task)
+        {
+            xTaskCreatePinnedToCore(task_main, "slint_mirror", 3 * 1024, this,
+                                    tskIDLE_PRIORITY + 1, &m_task, tskNO_AFFINITY);
+        }
+        m_active = true;
+    }
+
+    void stop() { m_active = false; }
+
+    /// Decides on the Slint task what the next frame sends: nothing while the bandwidth budget
+    /// is spent or the task still sends an earlier frame, otherwise its dirty rectangles, or the
+    /// whole screen to resynchronize.
+    Plan plan()
+    {
+        if (!m_active)
+            return Plan::Skip;
+        if (m_rate)
+        {
+            auto now = esp_timer_get_time();
+            auto refill = (now - m_last_refill) * int64_t(m_rate) / 1000000;
+            if (refill > 0)
+            {
+                m_last_refill = now;
+                if (m_tokens.fetch_add(refill) + refill > burst())
+                    m_tokens = burst();
+            }
+        }
+        if (m_busy || (m_rate && m_tokens < 0))
+        {
+            m_skipped++;
+            m_need_key = true;
+            return Plan::Skip;
+        }
+        return m_need_key.exchange(false) ? Plan::Key : Plan::Delta;
+    }
+
+    /// Copies a pushed rectangle of `bpp` byte pixels into the snapshot, opening the frame on
+    /// the first one. Never calls the sink.
+    void rect(const MirrorFrame &frame, const uint8_t *data, std::size_t stride_bytes,
+              std::size_t bpp, int32_t x, int32_t y, int32_t w, int32_t h)
+    {
+        if (!m_open)
+        {
+            m_open = true;
+            m_count = 0;
+            m_used = 0;
+            m_frame = frame;
+            m_bpp = bpp;
+            // The task still owns the snapshot when a pipelined frame was planned before the
+            // previous one was handed over.
+            m_dropped = m_busy;
+            auto needed = std::size_t(frame.width) * frame.height * bpp;
+            if (!m_dropped && m_capacity < needed)
+            {
+                // The task allocates a snapshot that holds a key frame; this frame is lost.
+                m_wanted = needed;
+                m_busy = true;
+                xTaskNotifyGive(m_task);
+                m_dropped = true;
+            }
+            if (m_dropped)
+            {
+                m_skipped++;
+                m_need_key = true;
+            }
+        }
+        auto bytes = std::size_t(w) * h * bpp;
+        if (m_dropped || m_count == MaxRects || m_used + bytes > m_capacity)
+        {
+            if (!m_dropped)
+            {
+                // Overlapping rectangles can add up to more than the screen.
+                m_dropped = true;
+                m_skipped++;
+                m_need_key = true;
+            }
+            return;
+        }
+        m_rects[m_count++] = {int16_t(x), int16_t(y), int16_t(w), int16_t(h), m_used};
+        for (int32_t row = 0; row < h; row++)
+        {
+            std::memcpy(m_snapshot + m_used, data + row * stride_bytes, w * bpp);
+            m_used += w * bpp;
+        }
+    }
+
+    /// Closes the frame opened by rect(), if any, and hands its snapshot to the task.
+    void end_frame()
+    {
+        if (!m_open)
+            return;
+        m_open = false;
+        if (m_dropped)
+            return;
+        m_busy = true;
+        xTaskNotifyGive(m_task);
+    }
+
+    SlintMirrorStats stats() const
+    {
+        return {m_frames.load(), m_skipped.load(), m_truncated.load(), m_rectangles.load(),
+                m_raw_bytes.load(), m_encoded_bytes.load()};
+    }
+
+private:
+    static constexpr std::size_t RunMax = 128;
+    /// More rectangles than the planner pushes per frame, plus the key frame.
+    static constexpr std::size_t MaxRects = 32;
+
+    struct Rect
+    {
+        int16_t x, y, w, h;
+        std::size_t offset;
+    };
+
+    static void task_main(void *arg)
+    {
+        auto self = static_cast<MirrorStream *>(arg);
+        while (true)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            if (!self->m_busy)
+                continue;
+            if (self->m_wanted > self->m_capacity)
+                self->grow();
+            else
+                self->send();
+            self->m_busy = false;
+        }
+    }
+
+    void grow()
+    {
+        if (m_snapshot)
+            m_arena.release(m_snapshot);
+        m_capacity = 0;
+        // PSRAM if there is any: the snapshot is only read by the CPU.
+        m_snapshot = static_cast<uint8_t *>(
+            m_arena.alloc(m_wanted, 4, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+        if (!m_snapshot)
+            m_snapshot = static_cast<uint8_t *>(m_arena.alloc(m_wanted, 4, MALLOC_CAP_8BIT));
+        if (m_snapshot)
+            m_capacity = m_wanted;
+        else
+            m_active = false;
+    }
+
+    /// Encodes the snapshot into the stream.
+    void send()
+    {
+        m_broken = false;
+        m_frame_bytes = 0;
+        uint8_t header[14] = {'S', 'L', 'M', 'F'};
+        put32(header + 4, m_sequence++);
+        put16(header + 8, m_frame.width);
+        put16(header + 10, m_frame.height);
+        header[12] = uint8_t(m_frame.format);
+        header[13] = m_frame.key ? 1 : 0;
+        out(header, sizeof(header));
+        for (std::size_t i = 0; i < m_count && !m_broken; i++)
+        {
+            auto &r = m_rects[i];
+            uint8_t rect[9] = {'R'};
+            put16(rect + 1, uint16_t(r.x));
+            put16(rect + 3, uint16_t(r.y));
+            put16(rect + 5, uint16_t(r.w));
+            put16(rect + 7, uint16_t(r.h));
+            out(rect, sizeof(rect));
+            m_rectangles++;
+            m_raw_bytes += uint32_t(r.w) * r.h * m_bpp;
+            auto row_bytes = std::size_t(r.w) * m_bpp;
+            for (int32_t row = 0; row < r.h && !m_broken; row++)
+            {
+                encode_row(m_snapshot + r.offset + row * row_bytes, r.w, m_bpp);
+            }
+        }
+        uint8_t trailer[5] = {'E'};
+        put32(trailer + 1, m_frame_bytes);
+        out(trailer, sizeof(trailer));
+        flush();
+        if (!m_broken)
+            m_frames++;
+    }
+
+    /// Bytes the stream may send in a burst, half a second's worth.
+    int64_t burst() const { return std::max<int64_t>(m_rate / 2, 4096); }
+
+    static void put16(uint8_t *p, uint16_t v)
+    {
+        p[0] = uint8_t(v);
+        p[1] = uint8_t(v >> 8);
+    }
+    static void put32(uint8_t *p, uint32_t v)
+    {
+        put16(p, uint16_t(v));
+        put16(p + 2, uint16_t(v >> 16));
+    }
+
+    void encode_row(const uint8_t *p, int32_t w, std::size_t bpp)
+    {
+        auto same = [&](int32_t a, int32_t b)
+        { return !std::memcmp(p + a * bpp, p + b * bpp, bpp); };
+        int32_t i = 0;
+        while (i < w)
+        {
+            int32_t run = 1;
+            while (i + run < w && run < int32_t(RunMax) && same(i, i + run))
+                run++;
+            if (run > 1)
+            {
+                uint8_t count = uint8_t(0x80 | (run - 1));
+                out(&count, 1);
+                out(p + i * bpp, bpp);
+                i += run;
+                continue;
+            }
+            int32_t start = i, n = 0;
+            do
+            {
+                n++;
+                i++;
+            } while (i < w && n < int32_t(RunMax) && !(i + 1 < w && same(i, i + 1)));
+            uint8_t count = uint8_t(n - 1);
+            out(&count, 1);
+            out(p + start * bpp, n * bpp);
+        }
+    }
+
+    void out(const uint8_t *data, std::size_t size)
+    {
+        m_frame_bytes += size;
+        while (size)
+        {
+            auto n = std::min(size, sizeof(m_staging) - m_staged);
+            std::memcpy(m_staging + m_staged, data, n);
+            m_staged += n;
+            data += n;
+            size -= n;
+            if (m_staged == sizeof(m_staging))
+                flush();
+        }
+    }
+
+    void flush()
+    {
+        if (!m_staged)
+            return;
+        if (!m_broken)
+        {
+            auto written = m_write(m_staging, m_staged, m_arg);
+            m_encoded_bytes += written;
+            m_tokens -= int64_t(written);
+            if (written < m_staged)
+            {
+                // The sink is full. The rest of the frame is dropped; the decoder notices the
+                // missing end marker and waits for the key frame that follows.
+                m_broken = true;
+                m_truncated++;
+                m_need_key = true;
+            }
+        }
+        m_staged = 0;
+    }
+
+    Arena &m_arena;
+    Write m_write = nullptr;
+    void *m_arg = nullptr;
+    uint32_t m_rate = 0;
+    std::atomic<bool> m_active{false};
+    std::atomic<bool> m_need_key{true};
+    std::atomic<int64_t> m_tokens{0};
+    int64_t m_last_refill = 0;
+    TaskHandle_t m_task = nullptr;
+
+    // The snapshot belongs to the task that pushes frames while `m_busy` is clear, and to the
+    // mirror task while it is set.
+    std::atomic<bool> m_busy{false};
+    std::atomic<std::size_t> m_wanted{0};
+    uint8_t *m_snapshot = nullptr;
+    std::size_t m_capacity = 0;
+    MirrorFrame m_frame{};
+    std::size_t m_bpp = 0;
+    Rect m_rects[MaxRects];
+    std::size_t m_count = 0;
+    std::size_t m_used = 0;
+    bool m_open = false;
+    bool m_dropped = false;
+
+    // Encoder state, only used by the mirror task.
+    bool m_broken = false;
+    uint32_t m_sequence = 0;
+    uint32_t m_frame_bytes = 0;
+    uint8_t m_staging[512];
+    std::size_t m_staged = 0;
+
+    std::atomic<uint32_t> m_frames{0};
+    std::atomic<uint32_t> m_skipped{0};
+    std::atomic<uint32_t> m_truncated{0};
+    std::atomic<uint32_t> m_rectangles{0};
+    std::atomic<uint32_t> m_raw_bytes{0};
+    std::atomic<uint32_t> m_encoded_bytes{0};
+};
@@ -0,0 +1,162 @@
+// Frame pacing: aligns flushes to the panel's tearing effect (TE) signal or to a fixed frame
+// period, and keeps statistics about how well frames meet their deadlines.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include "slint-lgfx.h"
+#include "slint-lgfx-gpio.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+class FramePacer
+{
+public:
+    /// Starts pacing on the rising edge of `te_pin` (if >= 0) and/or at `target_fps` (if > 0).
+    bool begin(int te_pin, uint32_t target_fps)
+    {
+        m_period_us = target_fps ? 1000000 / target_fps : 0;
+        m_te = te_pin >= 0 && attach_gpio_isr(te_pin, GPIO_INTR_POSEDGE, on_te, this);
+        m_next_slot = m_fps_window_start = esp_timer_get_time();
+        return te_pin < 0 || m_te;
+    }
+
+    bool enabled() const { return m_te || m_period_us; }
+
+    /// Microseconds until the next frame may start; 0 when it may start now.
+    int64_t until_slot() const
+    {
+        if (!m_period_us)
+            return 0;
+        return std::max<int64_t>(m_next_slot - esp_timer_get_time(), 0);
+    }
+
+    /// Marks the start of a frame in the current slot, moves the next slot one period on and
+    /// returns when this one started.
+    int64_t begin_frame()
+    {
+        auto now = esp_timer_get_time();
+        int64_t next = m_next_slot;
+        // Keep to the slot grid unless we were idle for longer than a period.
+        auto slot_start = m_period_us && now - next < m_period_us ? next : now;
+        if (m_period_us)
+            delay_slot(slot_start + m_period_us);
+        return slot_start;
+    }
+
+    /// Blocks until the next TE edge, so that pushing starts in vertical blanking. Called by the
+    /// task that pushes: the Slint task, or the flush task in pipeline mode. That task is
+    /// notified on the edge. Returns when the edge came, or 0 without one; the frame's slot
+    /// then starts there.
+    int64_t wait_for_te()
+    {
+        if (!m_te)
+            return 0;
+        m_task = xTaskGetCurrentTaskHandle();
+        auto seen = m_te_count.load();
+        auto te_gives = m_te_gives.load();
+        uint32_t taken = 0;
+        m_waiting = true;
+        // Other notifications may wake us early, and a TE line that stopped toggling must not
+        // hang the task. The poll is at least one tick, as 10 ms round down to 0 ticks below
+        // 100 Hz and the loop would spin.
+        auto deadline = esp_timer_get_time() + 50000;
+        const TickType_t poll_ticks = std::max<TickType_t>(pdMS_TO_TICKS(10), 1);
+        while (m_te_count.load() == seen && esp_timer_get_time() < deadline)
+        {
+            taken += ulTaskNotifyTake(pdTRUE, poll_ticks);
+        }
+        m_waiting = false;
+        // Hand back what posted tasks, quit, the update channel, touch interrupts or queued flush
+        // jobs gave, so that the task does not go idle on work that arrived while we waited. A TE
+        // give not taken here is still pending and wakes the task anyway.
+        if (taken > m_te_gives.load() - te_gives)
+            xTaskNotifyGive(m_task);
+        return m_te_count.load() != seen ? m_te_time.load() : 0;
+    }
+
+    /// Records that the frame whose slot started at `slot_start` reached the panel: counts
+    /// missed deadlines and skipped slots and moves the next slot past the ones that were
+    /// overrun. Called by the task that pushes, once the frame's last push is done; in pipeline
+    /// mode the Slint task may already render the next frame.
+    void frame_done(int64_t slot_start)
+    {
+        auto now = esp_timer_get_time();
+        m_frames++;
+        m_fps_frames++;
+
+        int64_t period = m_period_us ? m_period_us : m_te_period.load();
+        if (period > 0)
+        {
+            auto overrun = (now - slot_start) / period;
+            if (overrun > 0)
+            {
+                m_missed++;
+                m_skipped += overrun;
+            }
+            if (m_period_us)
+                delay_slot(slot_start + (overrun + 1) * period);
+        }
+
+        if (now - m_fps_window_start >= 1000000)
+        {
+            m_fps = m_fps_frames * 1e6f / float(now - m_fps_window_start);
+            m_fps_frames = 0;
+            m_fps_window_start = now;
+        }
+    }
+
+    SlintPacingStats stats() const
+    {
+        return {m_frames.load(), m_missed.load(), m_skipped.load(), m_fps.load()};
+    }
+
+private:
+    /// Moves the next slot to `next` unless the other task moved it further already.
+    void delay_slot(int64_t next)
+    {
+        auto current = m_next_slot.load();
+        while (next > current && !m_next_slot.compare_exchange_weak(current, next))
+        {
+        }
+    }
+
+    static void IRAM_ATTR on_te(void *arg)
+    {
+        auto self = static_cast<FramePacer *>(arg);
+        auto now = esp_timer_get_time();
+        auto last = self->m_te_time.exchange(now);
+        if (last)
+            self->m_te_period = now - last;
+        self->m_te_count++;
+        if (self->m_waiting)
+        {
+            BaseType_t woken = pdFALSE;
+            self->m_te_gives++;
+            vTaskNotifyGiveFromISR(self->m_task, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+    }
+
+    TaskHandle_t m_task = nullptr;
+    bool m_te = false;
+    int64_t m_period_us = 0;
+    /// Moved on by the Slint task when a frame starts, and by the pushing task when one overran.
+    std::atomic<int64_t> m_next_slot{0};
+
+    std::atomic<bool> m_waiting{false};
+    std::atomic<uint32_t> m_te_count{0};
+    std::atomic<uint32_t> m_te_gives{0};
+    std::atomic<int64_t> m_te_time{0};
+    std::atomic<int64_t> m_te_period{0};
+
+    std::atomic<uint32_t> m_frames{0};
+    std::atomic<uint32_t> m_missed{0};
+    std::atomic<uint32_t> m_skipped{0};
+    std::atomic<float> m_fps{0};
+    uint32_t m_fps_frames = 0;
+    int64_t m_fps_window_start = 0;
+};
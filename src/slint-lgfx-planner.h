@@ -0,0 +1,87 @@
+// Plans the push transactions for the dirty rectangles of a frame buffer.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+struct PlanRect
+{
+    int32_t x, y, w, h;
+};
+
+/**
+ * Merges, splits or promotes dirty rectangles so that a frame goes out in the fewest wire bytes,
+ * counting each transaction as `transaction_cost` extra bytes.
+ *
+ * Rectangles narrower than the stride are not contiguous in the frame buffer and are pushed row
+ * by row, unless they go through bounce buffers of `bounce_bytes` bytes. Merging pushes pixels
+ * outside the dirty region, which is fine because the frame buffer always holds the whole frame.
+ */
+struct RegionPlanner
+{
+    uint32_t transaction_cost;
+    uint32_t bpp;
+    int32_t stride;
+    int32_t height;
+    /// Size of a bounce buffer, or 0 when pushing straight from the frame buffer.
+    std::size_t bounce_bytes = 0;
+
+    uint64_t cost(const PlanRect &r) const
+    {
+        uint64_t bytes = uint64_t(r.w) * r.h * bpp;
+        uint64_t transactions;
+        if (bounce_bytes)
+            transactions = (bytes + bounce_bytes - 1) / bounce_bytes;
+        else
+            transactions = r.w == stride ? 1 : r.h;
+        return transactions * transaction_cost + bytes;
+    }
+
+    /// Returns `r` or `r` widened to full rows, whichever is cheaper to push.
+    PlanRect cheapest(const PlanRect &r) const
+    {
+        PlanRect wide{0, r.y, stride, r.h};
+        return cost(wide) < cost(r) ? wide : r;
+    }
+
+    /// Rewrites `rects[0..n)` in place and returns the new count.
+    std::size_t plan(PlanRect *rects, std::size_t n) const
+    {
+        for (std::size_t i = 0; i < n; i++)
+            rects[i] = cheapest(rects[i]);
+
+        bool merged = true;
+        while (merged && n > 1)
+        {
+            merged = false;
+            for (std::size_t i = 0; i < n && !merged; i++)
+            {
+                for (std::size_t j = i + 1; j < n && !merged; j++)
+                {
+                    auto &a = rects[i], &b = rects[j];
+                    auto x0 = std::min(a.x, b.x), y0 = std::min(a.y, b.y);
+                    auto x1 = std::max(a.x + a.w, b.x + b.w), y1 = std::max(a.y + a.h, b.y + b.h);
+                    auto both = cheapest({x0, y0, x1 - x0, y1 - y0});
+                    if (cost(both) <= cost(a) + cost(b))
+                    {
+                        a = both;
+                        b = rects[--n];
+                        merged = true;
+                    }
+                }
+            }
+        }
+
+        PlanRect full{0, 0, stride, height};
+        uint64_t total = 0;
+        for (std::size_t i = 0; i < n; i++)
+            total += cost(rects[i]);
+        if (n && total >= cost(full))
+        {
+            rects[0] = full;
+            n = 1;
+        }
+        return n;
+    }
+};
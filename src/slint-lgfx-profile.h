@@ -0,0 +1,180 @@
+// Per-frame hot-path instrumentation, compiled in with -DSLINT_LGFX_PROFILE.
+//
+// Phase times are measured with the CPU cycle counter and accumulated per frame. Each completed
+// frame is stored in a fixed-size ring from which slint_esp_profile_summary() computes min, avg,
+// p99 and max figures.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include "slint-lgfx.h"
+#include "esp_timer.h"
+
+#ifndef SLINT_LGFX_PROFILE_FRAMES
+#define SLINT_LGFX_PROFILE_FRAMES 64
+#endif
+
+#ifndef SLINT_LGFX_PROFILE_DUMP_MS
+#define SLINT_LGFX_PROFILE_DUMP_MS 5000
+#endif
+
+#ifdef SLINT_LGFX_PROFILE
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+enum class ProfilePhase : uint8_t
+{
+    Timers,
+    Render,
+    Convert,
+    Push,
+    Count,
+};
+
+class Profiler
+{
+public:
+    void add_cycles(ProfilePhase phase, uint32_t cycles)
+    {
+        m_cycles[std::size_t(phase)].fetch_add(cycles, std::memory_order_relaxed);
+    }
+    void add_idle(int64_t us) { m_idle_us.fetch_add(uint32_t(us), std::memory_order_relaxed); }
+    void add_rectangle(uint32_t pixels)
+    {
+        m_rectangles.fetch_add(1, std::memory_order_relaxed);
+        m_pixels.fetch_add(pixels, std::memory_order_relaxed);
+    }
+    void add_bytes(uint32_t bytes) { m_bytes.fetch_add(bytes, std::memory_order_relaxed); }
+
+    /// Moves the accumulated figures into the ring.
+    void end_frame()
+    {
+        auto per_us = std::max<uint32_t>(esp_rom_get_cpu_ticks_per_us(), 1);
+        Record r;
+        r.values[Timers] = m_cycles[std::size_t(ProfilePhase::Timers)].exchange(0) / per_us;
+        r.values[Render] = m_cycles[std::size_t(ProfilePhase::Render)].exchange(0) / per_us;
+        r.values[Convert] = m_cycles[std::size_t(ProfilePhase::Convert)].exchange(0) / per_us;
+        r.values[Push] = m_cycles[std::size_t(ProfilePhase::Push)].exchange(0) / per_us;
+        r.values[Idle] = m_idle_us.exchange(0);
+        r.values[Rectangles] = m_rectangles.exchange(0);
+        r.values[Pixels] = m_pixels.exchange(0);
+        r.values[Bytes] = m_bytes.exchange(0);
+        m_ring[m_frames % m_ring.size()] = r;
+        m_frames++;
+
+        auto now = esp_timer_get_time();
+        if (SLINT_LGFX_PROFILE_DUMP_MS > 0 && now - m_last_dump >= SLINT_LGFX_PROFILE_DUMP_MS * 1000)
+        {
+            m_last_dump = now;
+            slint_esp_profile_dump();
+        }
+    }
+
+    SlintProfileSummary summary() const
+    {
+        SlintProfileSummary out;
+        out.frames = std::min<uint32_t>(m_frames, m_ring.size());
+        if (!out.frames)
+            return out;
+        SlintProfileStat *stats[FieldCount] = {&out.timers_us,  &out.render_us, &out.convert_us,
+                                               &out.push_us,    &out.idle_us,   &out.rectangles,
+                                               &out.pixels,     &out.bytes};
+        std::array<uint32_t, SLINT_LGFX_PROFILE_FRAMES> values;
+        for (std::size_t f = 0; f < FieldCount; f++)
+        {
+            uint64_t sum = 0;
+            for (uint32_t i = 0; i < out.frames; i++)
+            {
+                values[i] = m_ring[i].values[f];
+                sum += values[i];
+            }
+            auto end = values.begin() + out.frames;
+            auto p99 = values.begin() + (out.frames * 99) / 100;
+            if (p99 == end)
+                --p99;
+            std::nth_element(values.begin(), p99, end);
+            auto [min, max] = std::minmax_element(values.begin(), end);
+            *stats[f] = {*min, uint32_t(sum / out.frames), *p99, *max};
+        }
+        return out;
+    }
+
+    void dump() const
+    {
+        auto s = summary();
+        auto line = [](const char *name, const SlintProfileStat &v)
+        { printf(" %s %lu/%lu/%lu", name, (unsigned long)v.min, (unsigned long)v.avg,
+                 (unsigned long)v.p99); };
+        printf("[slint] %lu frames (min/avg/p99 us):", (unsigned long)s.frames);
+        line("timers", s.timers_us);
+        line("render", s.render_us);
+        line("convert", s.convert_us);
+        line("push", s.push_us);
+        line("idle", s.idle_us);
+        line("rects", s.rectangles);
+        line("px", s.pixels);
+        line("bytes", s.bytes);
+        printf("\n");
+    }
+
+private:
+    enum Field
+    {
+        Timers,
+        Render,
+        Convert,
+        Push,
+        Idle,
+        Rectangles,
+        Pixels,
+        Bytes,
+        FieldCount
+    };
+    struct Record
+    {
+        std::array<uint32_t, FieldCount> values{};
+    };
+
+    std::array<std::atomic<uint32_t>, std::size_t(ProfilePhase::Count)> m_cycles{};
+    std::atomic<uint32_t> m_idle_us{0};
+    std::atomic<uint32_t> m_rectangles{0};
+    std::atomic<uint32_t> m_pixels{0};
+    std::atomic<uint32_t> m_bytes{0};
+
+    std::array<Record, SLINT_LGFX_PROFILE_FRAMES> m_ring{};
+    uint32_t m_frames = 0;
+    int64_t m_last_dump = 0;
+};
+
+/// Adds the cycles spent in the enclosing scope to a phase of the current frame.
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler &profiler, ProfilePhase phase)
+        : m_profiler(profiler), m_phase(phase), m_start(esp_cpu_get_cycle_count())
+    {
+    }
+    ~ProfileScope() { m_profiler.add_cycles(m_phase, esp_cpu_get_cycle_count() - m_start); }
+
+private:
+    Profiler &m_profiler;
+    ProfilePhase m_phase;
+    uint32_t m_start;
+};
+
+#define SLINT_PROFILE_CONCAT2(a, b) a##b
+#define SLINT_PROFILE_CONCAT(a, b) SLINT_PROFILE_CONCAT2(a, b)
+// Expects a Profiler named `profiler` in scope where it is used.
+#define SLINT_PROFILE_SCOPE(phase) \
+    ProfileScope SLINT_PROFILE_CONCAT(profile_scope_, __LINE__)(profiler, ProfilePhase::phase)
+#define SLINT_PROFILE(statement) statement
+
+#else
+
+#define SLINT_PROFILE_SCOPE(phase) ((void)0)
+#define SLINT_PROFILE(statement) ((void)0)
+
+#endif
@@ -0,0 +1,135 @@
+// Lock-free queues shared between the Slint task and the helper tasks of the platform.
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include "esp_attr.h"
+
+/**
+ * Bounded single-producer/single-consumer ring.
+ *
+ * `push` must only be called from one task and `pop` from one other task. `N` must be a power
+ * of two.
+ */
+template <typename T, std::size_t N>
+class SpscQueue
+{
+    static_assert((N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    bool push(const T &value)
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == N)
+            return false;
+        m_slots[head & (N - 1)] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+        value = m_slots[tail & (N - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<T, N> m_slots{};
+    std::atomic<std::size_t> m_head{0};
+    std::atomic<std::size_t> m_tail{0};
+};
+
+/**
+ * Bounded multi-producer/single-consumer ring with a sequence number per slot.
+ *
+ * `push` is lock-free and may be called from any task or ISR; `pop` must only be called from one
+ * task. Slots are allocated once by `init`, so neither side allocates afterwards.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+    /// Allocates `capacity` slots, rounded up to a power of two.
+    void init(std::size_t capacity)
+    {
+        std::size_t n = 1;
+        while (n < capacity)
+            n <<= 1;
+        m_slots = std::make_unique<Slot[]>(n);
+        m_mask = n - 1;
+        for (std::size_t i = 0; i < n; i++)
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    /// Moves `value` into the queue, or leaves it untouched and returns false when full.
+    bool IRAM_ATTR push(T &value)
+    {
+        auto pos = m_head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto &slot = m_slots[pos & m_mask];
+            auto diff = intptr_t(slot.seq.load(std::memory_order_acquire)) - intptr_t(pos);
+            if (diff == 0)
+            {
+                // The slot is free for this position; claim it.
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.value = std::move(value);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // The consumer has not released this slot from the previous lap yet.
+                return false;
+            }
+            else
+            {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T &value)
+    {
+        auto &slot = m_slots[m_tail & m_mask];
+        if (slot.seq.load(std::memory_order_acquire) != m_tail + 1)
+            return false;
+        value = std::move(slot.value);
+        slot.value = T{};
+        slot.seq.store(m_tail + m_mask + 1, std::memory_order_release);
+        m_tail++;
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_slots[m_tail & m_mask].seq.load(std::memory_order_acquire) != m_tail + 1;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::size_t> seq{0};
+        T value{};
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::size_t m_mask = 0;
+    std::atomic<std::size_t> m_head{0};
+    std::size_t m_tail = 0;
+};
@@ -1,11 +1,38 @@
 // See: https://github.com/slint-ui/slint/blob/ce50ea806a9a1d512d30acab6f99c8a1d511505f/api/cpp/esp-idf/slint/src/slint-esp.cpp
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <deque>
-#include <mutex>
+#include <type_traits>
+#include <utility>
 #include "slint-lgfx.h"
+#include "slint-lgfx-arena.h"
+#include "slint-lgfx-bus.h"
+#include "slint-lgfx-channel.h"
+#include "slint-lgfx-convert.h"
+#include "slint-lgfx-epd.h"
+#include "slint-lgfx-input.h"
+#include "slint-lgfx-memory.h"
+#include "slint-lgfx-mirror.h"
+#include "slint-lgfx-pacing.h"
+#include "slint-lgfx-planner.h"
+#include "slint-lgfx-profile.h"
+#include "slint-lgfx-queue.h"
 #include "slint-platform.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#if __has_include("esp_memory_utils.h")
+#include "esp_memory_utils.h"
+#else
+#include "soc/soc_memory_layout.h"
+#endif
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 static const char *TAG = "slint_platform";
 
@@ -31,17 +58,607 @@ public:
 };
 
 template <typename PixelType>
-struct LgfxPlatform : public slint::platform::Platform
+struct LgfxDisplay;
+
+/// A rendered region waiting to be converted and/or pushed by the flush task.
+template <typename PixelType>
+struct FlushJob
 {
-    LgfxPlatform(const SlintPlatformConfiguration<PixelType> &config)
+    enum Flags : uint8_t
+    {
+        /// Convert the rectangle in place.
+        Convert = 1,
+        /// Push the rectangle.
+        Push = 2,
+        /// Rows are tightly packed, so the rectangle is converted in place and pushed even when
+        /// the output format is smaller.
+        Packed = 4,
+        /// Hand the buffer back to the renderer.
+        Release = 8,
+        /// Last job of a frame.
+        FrameEnd = 16,
+        /// Refresh the e-paper panel with what was pushed before.
+        Refresh = 32,
+        /// Copy the pushed rectangle into the mirror stream's snapshot.
+        Mirror = 64,
+        /// Mirror as part of a key frame.
+        MirrorKey = 128,
+    };
+
+    PixelType *data = nullptr;
+    std::size_t stride = 0;
+    int32_t x = 0, y = 0, w = 0, h = 0;
+    uint8_t flags = 0;
+    LgfxDisplay<PixelType> *display = nullptr;
+    /// Set on the first push of a frame that shows input: when the oldest input was sampled.
+    int64_t input_us = 0;
+    /// Set on FrameEnd: when the frame's pacing slot started.
+    int64_t slot_us = 0;
+};
+
+/// Counters of the frame being flushed, published to `last_flush_stats` when it completes.
+struct FlushCounters
+{
+    std::atomic<uint32_t> rectangles{0};
+    std::atomic<uint32_t> transactions{0};
+    std::atomic<uint32_t> bytes{0};
+};
+
+static FlushCounters last_flush_stats;
+static FramePacer *active_pacer = nullptr;
+static EpdCounters epd_counters;
+static InputCounters input_counters;
+static MemoryMonitor memory_monitor;
+static Arena arena;
+static MirrorStream mirror_stream{arena};
+static BusArbiter bus_arbiter;
+
+/// Deleter of buffers from arena.alloc().
+static void arena_free(void *p)
+{
+    arena.release(p);
+}
+
+#ifdef SLINT_LGFX_PROFILE
+static Profiler profiler;
+#endif
+
+static void publish_stats(FlushCounters &counters)
+{
+    last_flush_stats.rectangles = counters.rectangles.exchange(0);
+    last_flush_stats.transactions = counters.transactions.exchange(0);
+    last_flush_stats.bytes = counters.bytes.exchange(0);
+    memory_monitor.sample();
+    mirror_stream.end_frame();
+    SLINT_PROFILE(profiler.end_frame());
+}
+
+/// Pipeline mode: rendered regions are converted and pushed by a flush task on another core.
+/// Buffers are owned by the flush task from the moment they are queued until the job that
+/// releases them has been pushed.
+template <typename PixelType>
+struct FlushPipeline
+{
+    TaskHandle_t task = nullptr;
+    SpscQueue<FlushJob<PixelType>, 16> jobs;
+    FlushCounters *counters = nullptr;
+    FramePacer *pacer = nullptr;
+    /// Whether the frame being flushed has waited for TE, and when the edge came. Only touched
+    /// by the flush task.
+    bool te_synced = false;
+    int64_t te_us = 0;
+
+    void queue(const FlushJob<PixelType> &job)
+    {
+        while (!jobs.push(job))
+        {
+            vTaskDelay(1);
+        }
+        xTaskNotifyGive(task);
+    }
+
+    static void task_main(void *arg);
+};
+
+/// Touch controller interrupt: set from the ISR, consumed by the event loop.
+struct TouchIrq
+{
+    std::atomic<bool> pending{false};
+    TaskHandle_t task = nullptr;
+};
+
+static void IRAM_ATTR on_touch_irq(void *arg)
+{
+    auto irq = static_cast<TouchIrq *>(arg);
+    irq->pending = true;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(irq->task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/// Work posted to the event loop: a Slint task from `run_in_event_loop`, or a plain function from
+/// `slint_esp_post`.
+struct PostedTask
+{
+    std::optional<slint::platform::Platform::Task> task;
+    void (*fn)(void *) = nullptr;
+    void *arg = nullptr;
+};
+
+/// The event loop's task queue. Posting never allocates and works from tasks and ISRs; only the
+/// event loop's own posts spill into a heap allocated overflow list when the queue is full.
+struct EventQueue
+{
+    MpscQueue<PostedTask> tasks;
+    /// Only touched by the event loop task.
+    std::deque<PostedTask> overflow;
+    TaskHandle_t task = nullptr;
+    SlintQueueFullPolicy full_policy = SlintQueueFullPolicy::Block;
+    std::atomic<bool> quit{false};
+    std::atomic<uint32_t> dropped{0};
+
+    /// Wakes the event loop, from an ISR or a task.
+    void IRAM_ATTR notify()
+    {
+        if (xPortInIsrContext())
+        {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(task, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+        else
+        {
+            xTaskNotifyGive(task);
+        }
+    }
+
+    bool IRAM_ATTR post(PostedTask &item, bool may_block = true)
+    {
+        bool isr = xPortInIsrContext();
+        if (!isr && xTaskGetCurrentTaskHandle() == task)
+            return post_from_loop(item, may_block);
+        while (!tasks.push(item))
+        {
+            if (!may_block || full_policy == SlintQueueFullPolicy::Drop || isr)
+            {
+                dropped++;
+                return false;
+            }
+            vTaskDelay(1);
+        }
+        notify();
+        return true;
+    }
+
+    /// The event loop's posts to itself. Kept out of IRAM and out of post(): the overflow list
+    /// allocates, which ISRs must never reach.
+    __attribute__((noinline)) bool post_from_loop(PostedTask &item, bool may_block)
+    {
+        // Behind the event loop's earlier overflow, to keep its own posts in order.
+        if (!overflow.empty())
+        {
+            overflow.push_back(std::move(item));
+        }
+        else if (!tasks.push(item))
+        {
+            if (!may_block || full_policy == SlintQueueFullPolicy::Drop)
+            {
+                dropped++;
+                return false;
+            }
+            // The event loop cannot wait for itself to drain the queue.
+            overflow.push_back(std::move(item));
+        }
+        notify();
+        return true;
+    }
+
+    /// Takes the next task, from the queue first and then from the overflow list.
+    bool pop(PostedTask &item)
+    {
+        if (tasks.pop(item))
+            return true;
+        if (overflow.empty())
+            return false;
+        item = std::move(overflow.front());
+        overflow.pop_front();
+        return true;
+    }
+};
+
+static EventQueue *active_events = nullptr;
+static UpdateChannel update_channel;
+
+namespace
+{
+    template <typename PixelType>
+    SlintPanelFormat resolve_format(SlintPanelFormat format, lgfx::LGFX_Device *gfx)
+    {
+        auto depth = gfx ? gfx->getColorDepth() : lgfx::color_depth_t::rgb888_3Byte;
+        // Only true RGB332 panels; grayscale and palette depths are 8 bits wide too.
+        if (format == SlintPanelFormat::Rgb332 ||
+            (format == SlintPanelFormat::Auto && depth == lgfx::color_depth_t::rgb332_1Byte))
+            return SlintPanelFormat::Rgb332;
+        if constexpr (std::is_same_v<PixelType, slint::platform::Rgb565Pixel>)
+        {
+            // RGB565 is pushed as is; LovyanGFX widens it for deeper panels.
+            return SlintPanelFormat::Rgb565;
+        }
+        else
+        {
+            if (format != SlintPanelFormat::Auto)
+                return format;
+            if (depth == lgfx::color_depth_t::rgb666_3Byte)
+                return SlintPanelFormat::Rgb666;
+            if ((depth & lgfx::color_depth_t::bit_mask) >= 24)
+                return SlintPanelFormat::Rgb888;
+            return SlintPanelFormat::Rgb565;
+        }
+    }
+
+    /// The conversion kernel for a resolved format, so that the per-line code does not branch
+    /// on the configuration.
+    template <typename PixelType>
+    convert::kernel_t select_kernel(SlintPanelFormat format, bool byte_swap, bool dither)
+    {
+        using namespace convert;
+        constexpr auto bytes = sizeof(PixelType);
+        if (format == SlintPanelFormat::Rgb332)
+            return dither ? to_rgb332<bytes, true> : to_rgb332<bytes, false>;
+        if constexpr (std::is_same_v<PixelType, slint::platform::Rgb565Pixel>)
+        {
+            return byte_swap ? anywhere<swap_rgb565> : anywhere<copy<2>>;
+        }
+        else
+        {
+            switch (format)
+            {
+            case SlintPanelFormat::Rgb565:
+                return byte_swap ? anywhere<rgb888_to_rgb565<true>>
+                                 : anywhere<rgb888_to_rgb565<false>>;
+            case SlintPanelFormat::Rgb666:
+                return byte_swap ? anywhere<rgb888_convert<true, true>>
+                                 : anywhere<rgb888_convert<false, true>>;
+            default:
+                return byte_swap ? anywhere<rgb888_convert<true, false>> : anywhere<copy<3>>;
+            }
+        }
+    }
+
+    /// The bus a panel is attached to, to tell which displays can transfer concurrently. Each
+    /// LovyanGFX device owns its bus object, so panels on one SPI host have different `IBus`
+    /// instances; what identifies the bus is its type and host or port.
+    struct BusId
+    {
+        enum class Source : uint8_t
+        {
+            /// Could be any bus: shared with every display.
+            Unknown,
+            /// Set with `bus_id`.
+            Config,
+            /// Read from the LovyanGFX bus configuration.
+            Detected,
+        };
+        Source source = Source::Unknown;
+        int type = 0;
+        int port = 0;
+
+        bool shared_with(const BusId &other) const
+        {
+            if (source == Source::Unknown || source != other.source)
+                return true;
+            return type == other.type && port == other.port;
+        }
+    };
+
+    BusId detect_bus(lgfx::LGFX_Device *gfx, int bus_id)
+    {
+        if (bus_id >= 0)
+            return {BusId::Source::Config, 0, bus_id};
+        auto panel = gfx ? gfx->getPanel() : nullptr;
+        auto bus = panel ? panel->getBus() : nullptr;
+        if (!bus)
+            return {};
+        // Parallel buses have no port number on every target (the ESP32-S3 has one i80 bus).
+        switch (bus->busType())
+        {
+        case lgfx::bus_spi:
+            return {BusId::Source::Detected, lgfx::bus_spi,
+                    int(static_cast<lgfx::Bus_SPI *>(bus)->config().spi_host)};
+        case lgfx::bus_i2c:
+            return {BusId::Source::Detected, lgfx::bus_i2c,
+                    int(static_cast<lgfx::Bus_I2C *>(bus)->config().i2c_port)};
+        default:
+            return {};
+        }
+    }
+}
+
+/// One panel and the window bound to it: buffers, conversion and flushing.
+template <typename PixelType>
+struct LgfxDisplay
+{
+    LgfxDisplay(const SlintDisplayConfiguration<PixelType> &config, FlushCounters &counters,
+                FlushPipeline<PixelType> *pipeline)
         : size(config.size),
           gfx(config.gfx),
           buffer1(config.buffer1),
           buffer2(config.buffer2),
           byte_swap(config.byte_swap),
-          rotation(config.rotation)
+          rotation(config.rotation),
+          format(resolve_format<PixelType>(config.panel_format, config.gfx)),
+          kernel(select_kernel<PixelType>(format, byte_swap, config.dither)),
+          converts(kernel != convert::anywhere<convert::copy<sizeof(PixelType)>>),
+          touch(config.touch),
+          bus(detect_bus(config.gfx, config.bus_id)),
+          band_lines(std::max<uint32_t>(config.band_lines, 1)),
+          band_count(std::max<uint32_t>(config.band_buffers, 1)),
+          transaction_cost(config.transaction_cost),
+          counters(counters),
+          pipeline(pipeline),
+          coalesce_moves(config.touch_filter.coalesce_moves)
+    {
+        if (config.buffer_placement != SlintBufferPlacement::None)
+        {
+            alloc_frame_buffers(config.buffer_placement, config.frame_buffers);
+        }
+        external = buffer1 && esp_ptr_external_ram(buffer1->data());
+        if (config.buffer_placement == SlintBufferPlacement::Psram)
+        {
+            external = true;
+        }
+
+        if (pipeline)
+        {
+            pipeline_buffers = buffer1 ? (buffer2 ? 2 : 1) : band_count;
+            free_buffers = xSemaphoreCreateCounting(pipeline_buffers, pipeline_buffers);
+        }
+
+        using slint::platform::SoftwareRenderer;
+        if (config.hardware_rotation && gfx &&
+            rotation != SoftwareRenderer::RenderingRotation::NoRotation)
+        {
+            // LovyanGFX rotations turn clockwise in quarter turns; 4-7 are the mirrored variants.
+            auto current = gfx->getRotation();
+            uint8_t wanted = (current & 4) | ((current + int(rotation) / 90) & 3);
+            gfx->setRotation(wanted);
+            if (gfx->getRotation() == wanted)
+            {
+                // The panel now scans in UI order: render unrotated, with pushes and touch
+                // coordinates in UI space.
+                rotation = SoftwareRenderer::RenderingRotation::NoRotation;
+            }
+            else
+            {
+                ESP_LOGW(TAG, "panel did not take rotation %d, rotating in software", wanted);
+                gfx->setRotation(current);
+            }
+        }
+        epd.begin(config.epd, gfx, epd_counters);
+        touch_filter.begin(config.touch_filter, input_counters);
+    }
+
+    slint::PhysicalSize size;
+    lgfx::LGFX_Device *gfx;
+    std::optional<std::span<PixelType>> buffer1;
+    std::optional<std::span<PixelType>> buffer2;
+    bool byte_swap;
+    slint::platform::SoftwareRenderer::RenderingRotation rotation;
+    SlintPanelFormat format;
+    convert::kernel_t kernel;
+    /// Whether the kernel changes the pixels, as opposed to copying them. Decided once with the
+    /// kernel, so the per-line paths test a flag rather than compare function pointers.
+    bool converts;
+    bool touch;
+    LgfxWindowAdapter *window = nullptr;
+
+    /// Set on the display that waits for the panel's TE signal before pushing, with the time
+    /// of the edge the last frame waited for (0 for none) when the Slint task pushes.
+    FramePacer *pacer = nullptr;
+    int64_t te_us = 0;
+    /// Set on the display that is mirrored.
+    MirrorStream *mirror = nullptr;
+    MirrorFormat mirror_format() const;
+    void mirror_rect(const PixelType *data, std::size_t stride, int32_t x, int32_t y, int32_t w,
+                     int32_t h, bool key);
+    /// Set when other displays render while this one's transfer is running.
+    bool overlap = false;
+    /// E-paper refresh batching; rendering waits until the batch is due.
+    EpdRefresher epd;
+    bool redraw_due = false;
+
+    std::size_t stride() const
+    {
+        return rotated() ? size.height : size.width;
+    }
+    std::size_t panel_height() const
+    {
+        return rotated() ? size.width : size.height;
+    }
+    bool rotated() const
+    {
+        using slint::platform::SoftwareRenderer;
+        return rotation == SoftwareRenderer::RenderingRotation::Rotate90 ||
+               rotation == SoftwareRenderer::RenderingRotation::Rotate270;
+    }
+
+    BusId bus;
+    bool shares_bus(const LgfxDisplay &other) const { return bus.shared_with(other.bus); }
+
+    void render_frame();
+    void handle_touch();
+
+    // Band buffers for line by line rendering, allocated on first use and kept for the
+    // lifetime of the platform.
+    using Uniq = std::unique_ptr<PixelType, void (*)(void *)>;
+    uint32_t band_lines;
+    uint32_t band_count;
+    std::vector<Uniq> bands;
+    void alloc_bands(std::size_t stride);
+    void render_by_bands(std::size_t stride);
+    void render_to_buffer(std::size_t stride);
+
+    // Frame buffers allocated by the library. Frame buffers in PSRAM are never read by DMA:
+    // dirty rectangles are converted into the band buffers and pushed from there.
+    std::vector<Uniq> frame_buffers;
+    bool external = false;
+    void alloc_frame_buffers(SlintBufferPlacement placement, uint32_t count);
+
+    // Conversion stage between rendering and pushing.
+    std::size_t out_bpp() const
+    {
+        return format == SlintPanelFormat::Rgb332 ? 1 : format == SlintPanelFormat::Rgb565 ? 2 : 3;
+    }
+    bool out_smaller() const { return out_bpp() < sizeof(PixelType); }
+    /// Dirty rectangles go out through the band buffers rather than from the frame buffer.
+    bool bounced() const { return out_smaller() || external; }
+    void convert_pixels(PixelType *src, uint8_t *dst, std::size_t n, int32_t x, int32_t y);
+    void convert_rect(PixelType *data, std::size_t stride, int32_t x, int32_t y, int32_t w,
+                      int32_t h);
+    void flush_rect(PixelType *data, std::size_t stride, int32_t x, int32_t y, int32_t w,
+                    int32_t h, bool dma = false);
+    void flush_packed(PixelType *data, int32_t x, int32_t y, int32_t w, int32_t h,
+                      bool dma = false);
+    void push_rect(const uint8_t *data, std::size_t stride, int32_t x, int32_t y, int32_t w,
+                   int32_t h, bool dma = false);
+    /// Next band buffer to fill. It carries over between frames: the band pushed last may still
+    /// be in flight when the next frame starts.
+    std::size_t bounce = 0;
+
+    // Asynchronous flushing: the last frame's DMA transfer may still be running while the next
+    // frame renders into the other buffer, or while other displays render. The bus transaction
+    // stays open until then.
+    bool flush_pending = false;
+    const PixelType *in_flight = nullptr;
+    bool async_flush() const { return gfx && !pipeline && (buffer2 || overlap); }
+    void finish_flush();
+
+    // Push planning and statistics.
+    uint32_t transaction_cost;
+    FlushCounters &counters;
+
+    FlushPipeline<PixelType> *pipeline;
+    SemaphoreHandle_t free_buffers = nullptr;
+    uint32_t pipeline_buffers = 0;
+    void wait_for_buffers();
+
+    // Touch input. A move held for coalescing is sent right before the next frame, or before
+    // the press or release that follows it.
+    TouchFilter touch_filter;
+    bool coalesce_moves;
+    TouchEvent held_move;
+    void dispatch(const TouchEvent &event);
+    void send_held_move();
+
+    // Latency tracing: the oldest event that the next frame shows, handed to the frame's first
+    // push when rendering starts.
+    int64_t input_us = 0;
+    int64_t frame_input_us = 0;
+    void shown(int64_t sampled_us);
+
+    // Bus arbitration: on an arbitrated bus, the bus is taken before a push rather than for the
+    // whole frame, and handed over between pushes (see BusArbiter).
+    BusArbiter *arbiter = nullptr;
+    bool holding_bus = false;
+    int64_t bus_held_since = 0;
+    void take_bus();
+    void release_bus();
+    void open_write()
+    {
+        if (!arbiter)
+            gfx->startWrite();
+    }
+    void close_write()
+    {
+        if (arbiter)
+            release_bus();
+        else
+            gfx->endWrite();
+    }
+};
+
+template <typename PixelType>
+struct LgfxPlatform : public slint::platform::Platform
+{
+    LgfxPlatform(const SlintPlatformConfiguration<PixelType> &config)
     {
         task = xTaskGetCurrentTaskHandle();
+        memory_monitor.slint_task = task;
+
+        events.task = task;
+        events.full_policy = config.task_queue_full;
+        events.tasks.init(std::max<uint32_t>(config.task_queue_size, 2));
+        active_events = &events;
+
+        if (config.bus_slice_us)
+        {
+            bus_arbiter.begin(config.bus_slice_us, config.bus_priority);
+        }
+
+        if (!pacer.begin(config.te_pin, config.target_fps))
+        {
+            ESP_LOGW(TAG, "could not attach TE interrupt to GPIO %d", config.te_pin);
+        }
+        active_pacer = &pacer;
+
+        if (config.touch_int_pin >= 0)
+        {
+            touch_irq.task = task;
+            touch_interrupt = attach_gpio_isr(config.touch_int_pin, GPIO_INTR_NEGEDGE,
+                                              on_touch_irq, &touch_irq);
+            if (!touch_interrupt)
+            {
+                ESP_LOGW(TAG, "could not attach touch interrupt to GPIO %d, polling instead",
+                         config.touch_int_pin);
+            }
+        }
+
+        if (config.flush_task_core)
+        {
+            pipeline = std::make_unique<FlushPipeline<PixelType>>();
+            pipeline->counters = &counters;
+            pipeline->pacer = &pacer;
+            xTaskCreatePinnedToCore(FlushPipeline<PixelType>::task_main, "slint_flush", 4 * 1024,
+                                    pipeline.get(), uxTaskPriorityGet(nullptr), &pipeline->task,
+                                    *config.flush_task_core);
+            memory_monitor.flush_task = pipeline->task;
+        }
+
+        add_display({.size = config.size,
+                     .gfx = config.gfx,
+                     .buffer1 = config.buffer1,
+                     .buffer2 = config.buffer2,
+                     .rotation = config.rotation,
+                     .hardware_rotation = config.hardware_rotation,
+                     .byte_swap = config.byte_swap,
+                     .panel_format = config.panel_format,
+                     .band_lines = config.band_lines,
+                     .band_buffers = config.band_buffers,
+                     .transaction_cost = config.transaction_cost,
+                     .touch = true,
+                     .epd = config.epd,
+                     .buffer_placement = config.buffer_placement,
+                     .frame_buffers = config.frame_buffers,
+                     .touch_filter = config.touch_filter,
+                     .dither = config.dither,
+                     .bus_id = config.bus_id});
+        displays.front()->pacer = &pacer;
+        displays.front()->mirror = &mirror_stream;
+    }
+
+    void add_display(const SlintDisplayConfiguration<PixelType> &config)
+    {
+        displays.push_back(
+            std::make_unique<LgfxDisplay<PixelType>>(config, counters, pipeline.get()));
+        auto &display = *displays.back();
+        if (bus_arbiter.enabled() && display.gfx && display.shares_bus(*displays.front()))
+        {
+            display.arbiter = &bus_arbiter;
+        }
+        for (auto &d : displays)
+        {
+            d->overlap = displays.size() > 1;
+        }
     }
 
     std::unique_ptr<slint::platform::WindowAdapter> create_window_adapter() override;
@@ -52,34 +669,41 @@ struct LgfxPlatform : public slint::platform::Platform
     void run_in_event_loop(Task) override;
 
 private:
-    slint::PhysicalSize size;
-    lgfx::LGFX_Device* gfx;
-    std::optional<std::span<PixelType>> buffer1;
-    std::optional<std::span<PixelType>> buffer2;
-    bool byte_swap;
-    slint::platform::SoftwareRenderer::RenderingRotation rotation;
-    class LgfxWindowAdapter *m_window = nullptr;
+    std::vector<std::unique_ptr<LgfxDisplay<PixelType>>> displays;
+
+    FramePacer pacer;
+    FlushCounters counters;
+    std::unique_ptr<FlushPipeline<PixelType>> pipeline;
+
+    // With a touch interrupt, the first display's controller is only read after it signalled or
+    // while a contact is active, and the loop can sleep until something happens.
+    bool touch_interrupt = false;
+    TouchIrq touch_irq;
 
     static TaskHandle_t task;
-    std::mutex queue_mutex;
-    std::deque<slint::platform::Platform::Task> queue;
-    bool quit = false;
+    EventQueue events;
 };
 
+/// The platform set by slint_esp_init(), for slint_esp_add_display().
+template <typename PixelType>
+static LgfxPlatform<PixelType> *active_platform = nullptr;
+
 template <typename PixelType>
 std::unique_ptr<slint::platform::WindowAdapter> LgfxPlatform<PixelType>::create_window_adapter()
 {
-    if (m_window != nullptr)
+    auto it = std::find_if(displays.begin(), displays.end(), [](auto &d) { return !d->window; });
+    if (it == displays.end())
     {
-        ESP_LOGI(TAG, "FATAL: create_window_adapter called multiple times");
+        ESP_LOGI(TAG, "FATAL: create_window_adapter called more often than there are displays");
         return nullptr;
     }
+    auto &display = **it;
 
     auto buffer_type =
-        buffer2 ? RepaintBufferType::SwappedBuffers : RepaintBufferType::ReusedBuffer;
-    auto window = std::make_unique<LgfxWindowAdapter>(buffer_type, size);
-    m_window = window.get();
-    m_window->m_renderer.set_rendering_rotation(rotation);
+        display.buffer2 ? RepaintBufferType::SwappedBuffers : RepaintBufferType::ReusedBuffer;
+    auto window = std::make_unique<LgfxWindowAdapter>(buffer_type, display.size);
+    display.window = window.get();
+    display.window->m_renderer.set_rendering_rotation(display.rotation);
     return window;
 }
 
@@ -90,218 +714,1053 @@ std::chrono::milliseconds LgfxPlatform<PixelType>::duration_since_start()
     return std::chrono::milliseconds(pdTICKS_TO_MS(ticks));
 }
 
-namespace
-{
-    void byte_swap_color(slint::platform::Rgb565Pixel *pixel)
-    {
-        auto px = reinterpret_cast<uint16_t *>(pixel);
-        *px = (*px << 8) | (*px >> 8);
-    }
-    void byte_swap_color(slint::Rgb8Pixel *pixel)
-    {
-        std::swap(pixel->r, pixel->b);
-    }
-}
-
 template <typename PixelType>
 void LgfxPlatform<PixelType>::run_event_loop()
 {
-    TickType_t max_ticks_to_wait = pdMS_TO_TICKS(10);
-
-    float last_touch_x = 0;
-    float last_touch_y = 0;
-    bool touch_down = false;
+    // Without a touch interrupt, the touch controller is polled at this interval.
+    const TickType_t touch_poll_ticks = pdMS_TO_TICKS(10);
 
     while (true)
     {
-        slint::platform::update_timers_and_animations();
+        {
+            SLINT_PROFILE_SCOPE(Timers);
+            slint::platform::update_timers_and_animations();
+        }
 
-        std::optional<slint::platform::Platform::Task> event;
+        PostedTask event;
+        if (events.pop(event))
         {
-            std::unique_lock lock(queue_mutex);
-            if (queue.empty())
-            {
-                if (quit)
-                {
-                    quit = false;
-                    break;
-                }
-            }
+            if (event.task)
+                std::move(*event.task).run();
             else
+                event.fn(event.arg);
+            continue;
+        }
+        if (events.quit.exchange(false))
+        {
+            for (auto &d : displays)
             {
-                event = std::move(queue.front());
-                queue.pop_front();
+                d->finish_flush();
+                d->wait_for_buffers();
             }
+            break;
         }
-        if (event)
+
+        auto &primary = *displays.front();
+        bool read_primary =
+            !touch_interrupt || primary.touch_filter.active() || touch_irq.pending.exchange(false);
+        // Channel values change properties and request redraws, so they go in right before a
+        // frame may render.
+        if (pacer.until_slot() == 0)
+            update_channel.drain();
+
+        bool redraw = false;
+        int64_t epd_wait_us = 0;
+        for (auto &d : displays)
         {
-            std::move(*event).run();
-            event.reset();
-            continue;
+            if (!d->window)
+                continue;
+            if (d->touch && (d.get() != &primary || read_primary))
+                d->handle_touch();
+            if (pacer.until_slot() == 0)
+                d->send_held_move();
+            d->redraw_due = d->window->needs_redraw;
+            if (d->redraw_due && d->epd.enabled())
+            {
+                // E-paper changes wait for the rest of their batch.
+                auto wait = d->epd.until_due(esp_timer_get_time(),
+                                             d->window->window().has_active_animations());
+                d->redraw_due = wait == 0;
+                if (wait)
+                    epd_wait_us = epd_wait_us ? std::min(epd_wait_us, wait) : wait;
+            }
+            redraw |= d->redraw_due;
         }
 
-        if (m_window)
+        if (redraw && pacer.until_slot() == 0)
         {
-            int32_t touch_x = 0, touch_y = 0;
-            bool touched = false;
-            if (gfx) {
-                 touched = gfx->getTouch(&touch_x, &touch_y);
-            }
+            auto slot_start = pacer.begin_frame();
+            auto frame_start = esp_timer_get_time();
 
-            if (touched)
+            // Only dirty windows are rendered. A display waits for the transfers still running
+            // on its bus; transfers on other buses continue while it renders.
+            for (auto &d : displays)
             {
-                auto scale_factor = m_window->window().scale_factor();
-                last_touch_x = float(touch_x) / scale_factor;
-                last_touch_y = float(touch_y) / scale_factor;
-                
-                m_window->window().dispatch_pointer_move_event(
-                    slint::LogicalPosition({last_touch_x, last_touch_y}));
-                
-                if (!touch_down)
+                if (!d->window || !d->redraw_due)
+                    continue;
+                d->window->needs_redraw = false;
+                for (auto &other : displays)
                 {
-                    m_window->window().dispatch_pointer_press_event(
-                        slint::LogicalPosition({last_touch_x, last_touch_y}),
-                        slint::PointerEventButton::Left);
+                    if (other != d && other->shares_bus(*d))
+                        other->finish_flush();
                 }
-                touch_down = true;
-            }
-            else if (touch_down)
-            {
-                m_window->window().dispatch_pointer_release_event(
-                    slint::LogicalPosition({last_touch_x, last_touch_y}),
-                    slint::PointerEventButton::Left);
-                m_window->window().dispatch_pointer_exit_event();
-                touch_down = false;
+                d->render_frame();
             }
+            memory_monitor.sample();
 
-            if (std::exchange(m_window->needs_redraw, false))
+            // The frame is done when its pushes are: in pipeline mode, on the flush task.
+            if (pipeline)
             {
-                using slint::platform::SoftwareRenderer;
-                auto rotated = rotation == SoftwareRenderer::RenderingRotation::Rotate90 || rotation == SoftwareRenderer::RenderingRotation::Rotate270;
-                auto stride = rotated ? size.height : size.width;
-                
-                if (gfx) gfx->startWrite();
-
-                if (buffer1)
-                {
-                    auto region = m_window->m_renderer.render(buffer1.value(), stride);
-
-                    if (byte_swap)
-                    {
-                        for (auto [o, s] : region.rectangles())
-                        {
-                            for (int y = o.y; y < o.y + s.height; y++)
-                            {
-                                for (int x = o.x; x < o.x + s.width; x++)
-                                {
-                                    byte_swap_color(&buffer1.value()[y * stride + x]);
-                                }
-                            }
-                        }
-                    }
-
-                    if (buffer2)
-                    {
-                        for (auto [o, s] : region.rectangles())
-                        {
-                             if (gfx) gfx->pushImage(o.x, o.y, s.width, s.height, (const uint16_t*)(buffer1->data() + o.y * stride + o.x));
-                        }
-                        
-                        std::swap(buffer1, buffer2);
-                    }
-                    else
-                    {
-                        for (auto [o, s] : region.rectangles())
-                        {
-                            if (gfx) gfx->pushImage(o.x, o.y, s.width, s.height, (const uint16_t*)(buffer1->data() + o.y * stride + o.x));
-                        }
-                    }
-                }
-                else
-                {
-                    // Line by line
-                    using Uniq = std::unique_ptr<PixelType, void (*)(void *)>;
-                    auto alloc = [&]
-                    {
-                        void *ptr = heap_caps_malloc(stride * sizeof(PixelType),
-                                                     MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-                        if (!ptr)
-                        {
-                            ESP_LOGE(TAG, "malloc failed to allocate line buffer");
-                            abort();
-                        }
-                        return Uniq(reinterpret_cast<PixelType *>(ptr), heap_caps_free);
-                    };
-                    Uniq lb[1] = {alloc()};
-                    
-                    m_window->m_renderer.render_by_line<PixelType>(
-                        [this, &lb](std::size_t line_y, std::size_t line_start,
-                                          std::size_t line_end, auto &&render_fn)
-                        {
-                            std::span<PixelType> view{lb[0].get(), line_end - line_start};
-                            render_fn(view);
-                            if (byte_swap)
-                            {
-                                std::for_each(view.begin(), view.end(),
-                                              [](auto &rgbpix)
-                                              { byte_swap_color(&rgbpix); });
-                            }
-                            
-                            if (gfx) gfx->pushImage(line_start, line_y, line_end - line_start, 1, (const uint16_t*)view.data());
-                        });
-                }
-                
-                if (gfx) gfx->endWrite();
+                pipeline->queue({.flags = FlushJob<PixelType>::FrameEnd, .slot_us = slot_start});
             }
-
-            if (m_window->window().has_active_animations())
+            else
             {
-                continue;
+                publish_stats(counters);
+                auto te_us = std::exchange(displays.front()->te_us, 0);
+                pacer.frame_done(te_us ? te_us : slot_start);
             }
+            ESP_LOGD(TAG, "frame rendered in %lld us", (long long)(esp_timer_get_time() - frame_start));
+        }
+
+        bool animating = false;
+        for (auto &d : displays)
+        {
+            // E-paper displays do not show intermediate animation frames.
+            animating |= d->window && !d->epd.enabled() &&
+                         d->window->window().has_active_animations();
+        }
+        if (animating && pacer.until_slot() == 0)
+        {
+            continue;
+        }
+
+        // Nothing left to overlap with, so let the transfers complete and release the buses.
+        bool poll_touch = false;
+        for (auto &d : displays)
+        {
+            d->finish_flush();
+            // Keep polling while a contact is active to catch moves and the release.
+            poll_touch |= d->touch && (d.get() != &primary || !touch_interrupt ||
+                                       d->touch_filter.active());
         }
 
-        TickType_t ticks_to_wait = max_ticks_to_wait;
+        TickType_t ticks_to_wait = poll_touch ? touch_poll_ticks : portMAX_DELAY;
+        if (auto slot_us = pacer.until_slot())
+        {
+            ticks_to_wait = std::min(ticks_to_wait, pdMS_TO_TICKS((slot_us + 999) / 1000));
+        }
+        if (epd_wait_us)
+        {
+            ticks_to_wait = std::min(ticks_to_wait, pdMS_TO_TICKS((epd_wait_us + 999) / 1000));
+        }
         if (auto wait_time = slint::platform::duration_until_next_timer_update())
         {
             ticks_to_wait = std::min(ticks_to_wait, pdMS_TO_TICKS(wait_time->count()));
         }
 
+        SLINT_PROFILE(auto idle_start = esp_timer_get_time());
         ulTaskNotifyTake(/*reset to zero*/ pdTRUE, ticks_to_wait);
+        SLINT_PROFILE(profiler.add_idle(esp_timer_get_time() - idle_start));
     }
 
     vTaskDelete(NULL);
 }
 
 template <typename PixelType>
-void LgfxPlatform<PixelType>::quit_event_loop()
+void LgfxDisplay<PixelType>::handle_touch()
 {
+    auto sampled = esp_timer_get_time();
+    int32_t touch_x = 0, touch_y = 0;
+    bool touched = gfx && gfx->getTouch(&touch_x, &touch_y);
+
+    if (touched)
+    {
+        // With software rotation the controller reports panel coordinates; map them back into
+        // the rotated UI.
+        using slint::platform::SoftwareRenderer;
+        int32_t panel_w = stride(), panel_h = panel_height();
+        int32_t px = touch_x, py = touch_y;
+        switch (rotation)
+        {
+        case SoftwareRenderer::RenderingRotation::Rotate90:
+            touch_x = py;
+            touch_y = panel_w - 1 - px;
+            break;
+        case SoftwareRenderer::RenderingRotation::Rotate180:
+            touch_x = panel_w - 1 - px;
+            touch_y = panel_h - 1 - py;
+            break;
+        case SoftwareRenderer::RenderingRotation::Rotate270:
+            touch_x = panel_h - 1 - py;
+            touch_y = px;
+            break;
+        default:
+            break;
+        }
+    }
+
+    auto event = touch_filter.sample(touched, touch_x, touch_y, sampled);
+    if (event.kind == TouchEvent::Kind::Move && coalesce_moves)
+    {
+        if (held_move.kind != TouchEvent::Kind::None)
+        {
+            input_counters.coalesced++;
+            // The replaced move was sampled first, so its time stays for the latency.
+            event.sampled_us = held_move.sampled_us;
+        }
+        held_move = event;
+        return;
+    }
+    if (event.kind != TouchEvent::Kind::None)
     {
-        const std::unique_lock lock(queue_mutex);
-        quit = true;
+        send_held_move();
+        dispatch(event);
     }
-    vTaskNotifyGiveFromISR(task, nullptr);
 }
 
 template <typename PixelType>
-void LgfxPlatform<PixelType>::run_in_event_loop(slint::platform::Platform::Task event)
+void LgfxDisplay<PixelType>::send_held_move()
+{
+    if (held_move.kind == TouchEvent::Kind::None)
+        return;
+    dispatch(held_move);
+    held_move = {};
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::dispatch(const TouchEvent &event)
 {
+    auto scale_factor = window->window().scale_factor();
+    slint::LogicalPosition position({float(event.x) / scale_factor, float(event.y) / scale_factor});
+    switch (event.kind)
     {
-        const std::unique_lock lock(queue_mutex);
-        queue.push_back(std::move(event));
+    case TouchEvent::Kind::Press:
+        window->window().dispatch_pointer_move_event(position);
+        window->window().dispatch_pointer_press_event(position, slint::PointerEventButton::Left);
+        break;
+    case TouchEvent::Kind::Move:
+        window->window().dispatch_pointer_move_event(position);
+        break;
+    case TouchEvent::Kind::Release:
+        window->window().dispatch_pointer_release_event(position, slint::PointerEventButton::Left);
+        window->window().dispatch_pointer_exit_event();
+        break;
+    case TouchEvent::Kind::None:
+        return;
     }
-    vTaskNotifyGiveFromISR(task, nullptr);
+    input_counters.events++;
+
+    // The event is shown by the next frame if it left the window dirty.
+    if (!window->needs_redraw)
+        input_counters.no_effect++;
+    else if (!input_us)
+        input_us = event.sampled_us;
 }
 
 template <typename PixelType>
-TaskHandle_t LgfxPlatform<PixelType>::task = {};
-
-void slint_esp_init(const SlintPlatformConfiguration<slint::platform::Rgb565Pixel> &config)
+void LgfxDisplay<PixelType>::shown(int64_t sampled_us)
 {
-    slint::platform::set_platform(
-        std::make_unique<LgfxPlatform<slint::platform::Rgb565Pixel>>(config));
+    if (sampled_us)
+        input_counters.record_latency(esp_timer_get_time() - sampled_us);
 }
 
-void slint_esp_init(const SlintPlatformConfiguration<slint::Rgb8Pixel> &config)
+template <typename PixelType>
+void LgfxDisplay<PixelType>::render_frame()
+{
+    // The first push of this frame shows the input dispatched since the last one.
+    frame_input_us = std::exchange(input_us, 0);
+
+    // An asynchronous flush keeps the bus until its transfer is waited for. On an arbitrated bus
+    // it must not stay taken while this frame renders; the first push takes it again.
+    if (arbiter)
+        finish_flush();
+
+    // In pipeline mode the flush task owns the bus transactions.
+    if (gfx && !pipeline) open_write();
+
+    if (buffer1)
+    {
+        render_to_buffer(stride());
+    }
+    else
+    {
+        render_by_bands(stride());
+    }
+
+    if (gfx && !pipeline)
+    {
+        if (async_flush() && !flush_pending)
+            flush_pending = true;
+        else if (!arbiter)
+            gfx->endWrite();
+        else if (!async_flush())
+            release_bus();
+    }
+
+    if (epd.enabled())
+    {
+        if (pipeline)
+        {
+            pipeline->queue({.flags = FlushJob<PixelType>::Refresh, .display = this});
+        }
+        else
+        {
+            finish_flush();
+            take_bus();
+            epd.refresh(gfx);
+            release_bus();
+        }
+    }
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::convert_pixels(PixelType *src, uint8_t *dst, std::size_t n,
+                                             int32_t x, int32_t y)
+{
+    SLINT_PROFILE_SCOPE(Convert);
+    kernel(reinterpret_cast<uint8_t *>(src), dst, n, x, y);
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::convert_rect(PixelType *data, std::size_t stride, int32_t x,
+                                           int32_t y, int32_t w, int32_t h)
+{
+    if (!converts)
+        return;
+    if (std::size_t(w) == stride)
+    {
+        convert_pixels(data, reinterpret_cast<uint8_t *>(data), w * h, x, y);
+        return;
+    }
+    for (int32_t row = 0; row < h; row++)
+    {
+        auto line = data + row * stride;
+        convert_pixels(line, reinterpret_cast<uint8_t *>(line), w, x, y + row);
+    }
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::flush_packed(PixelType *data, int32_t x, int32_t y, int32_t w,
+                                           int32_t h, bool dma)
+{
+    auto bytes = reinterpret_cast<uint8_t *>(data);
+    if (format == SlintPanelFormat::Rgb332)
+    {
+        // The dither pattern follows the rows.
+        for (int32_t row = 0; row < h; row++)
+            convert_pixels(data + row * w, bytes + row * w * out_bpp(), w, x, y + row);
+    }
+    else
+    {
+        convert_pixels(data, bytes, w * h, x, y);
+    }
+    push_rect(bytes, w, x, y, w, h, dma);
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::flush_rect(PixelType *data, std::size_t stride, int32_t x,
+                                         int32_t y, int32_t w, int32_t h, bool dma)
+{
+    if (!bounced())
+    {
+        // Already converted in place.
+        push_rect(reinterpret_cast<uint8_t *>(data), stride, x, y, w, h, dma);
+        return;
+    }
+
+    // The frame buffer keeps the rendered pixels; the rows are converted while they are copied
+    // into the band buffers, and pushed from there.
+    auto capacity = stride * band_lines * sizeof(PixelType);
+    auto rows_per_band = std::max<std::size_t>(capacity / (w * out_bpp()), 1);
+    for (int32_t row = 0; row < h; row += rows_per_band)
+    {
+        auto rows = std::min<int32_t>(rows_per_band, h - row);
+        auto out = reinterpret_cast<uint8_t *>(bands[bounce].get());
+        for (int32_t r = 0; r < rows; r++)
+        {
+            convert_pixels(data + (row + r) * stride, out + r * w * out_bpp(), w, x,
+                           y + row + r);
+        }
+        push_rect(out, w, x, y + row, w, rows, bands.size() > 1);
+        bounce = (bounce + 1) % bands.size();
+    }
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::push_rect(const uint8_t *data, std::size_t stride, int32_t x,
+                                        int32_t y, int32_t w, int32_t h, bool dma)
+{
+    if (!gfx)
+        return;
+    if (epd.enabled())
+        epd.add_rect(x, y, w, h);
+    auto push = [&](int32_t py, int32_t rows, const uint8_t *p)
+    {
+        take_bus();
+        SLINT_PROFILE_SCOPE(Push);
+        SLINT_PROFILE(profiler.add_bytes(w * rows * out_bpp()));
+        counters.transactions++;
+        counters.bytes += w * rows * out_bpp();
+        if (out_bpp() == 3)
+        {
+            // Rgb8Pixel has the byte order of LovyanGFX's bgr888_t.
+            if (dma)
+                gfx->pushImageDMA(x, py, w, rows, (const lgfx::bgr888_t *)p);
+            else
+                gfx->pushImage(x, py, w, rows, (const lgfx::bgr888_t *)p);
+        }
+        else if (out_bpp() == 1)
+        {
+            if (dma)
+                gfx->pushImageDMA(x, py, w, rows, (const lgfx::rgb332_t *)p);
+            else
+                gfx->pushImage(x, py, w, rows, (const lgfx::rgb332_t *)p);
+        }
+        else
+        {
+            if (dma)
+                gfx->pushImageDMA(x, py, w, rows, (const uint16_t *)p);
+            else
+                gfx->pushImage(x, py, w, rows, (const uint16_t *)p);
+        }
+    };
+    if (std::size_t(w) == stride)
+    {
+        push(y, h, data);
+        return;
+    }
+    // pushImage expects tightly packed rows, so narrower rectangles go out row by row.
+    for (int32_t row = 0; row < h; row++)
+    {
+        push(y + row, 1, data + row * stride * out_bpp());
+    }
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::render_to_buffer(std::size_t stride)
+{
+    if (pipeline)
+    {
+        // Wait until the flush task is done with the buffer we are about to render into.
+        xSemaphoreTake(free_buffers, portMAX_DELAY);
+    }
+
+    if (bounced())
+    {
+        alloc_bands(stride);
+    }
+    if (in_flight == buffer1->data())
+    {
+        // Fence: this buffer is still being transmitted.
+        SLINT_PROFILE_SCOPE(Push);
+        gfx->waitDMA();
+        in_flight = nullptr;
+    }
+
+    auto region = [&]
+    {
+        SLINT_PROFILE_SCOPE(Render);
+        return window->m_renderer.render(buffer1.value(), stride);
+    }();
+
+    using Job = FlushJob<PixelType>;
+    auto mirror_plan = mirror ? mirror->plan() : MirrorStream::Plan::Skip;
+
+    std::array<PlanRect, 16> rects;
+    std::size_t count = 0;
+    for (auto [o, s] : region.rectangles())
+    {
+        PlanRect r{o.x, o.y, int32_t(s.width), int32_t(s.height)};
+        counters.rectangles++;
+        SLINT_PROFILE(profiler.add_rectangle(r.w * r.h));
+
+        // Conversion in place must only touch dirty pixels, so it happens before planning.
+        if (!bounced() && converts)
+        {
+            auto data = buffer1->data() + r.y * stride + r.x;
+            if (pipeline)
+                pipeline->queue({data, stride, r.x, r.y, r.w, r.h, Job::Convert, this});
+            else
+                convert_rect(data, stride, r.x, r.y, r.w, r.h);
+        }
+
+        if (count < rects.size())
+        {
+            rects[count++] = r;
+        }
+        else
+        {
+            // More rectangles than we plan for; fold the rest into the last one.
+            auto &l = rects.back();
+            auto x1 = std::max(l.x + l.w, r.x + r.w), y1 = std::max(l.y + l.h, r.y + r.h);
+            l.x = std::min(l.x, r.x);
+            l.y = std::min(l.y, r.y);
+            l.w = x1 - l.x;
+            l.h = y1 - l.y;
+        }
+    }
+
+    RegionPlanner planner{transaction_cost, uint32_t(out_bpp()), int32_t(stride),
+                          int32_t(panel_height())};
+    if (bounced())
+    {
+        planner.bounce_bytes = stride * band_lines * sizeof(PixelType);
+    }
+    count = planner.plan(rects.data(), count);
+
+    // In pipeline mode the flush task waits, right before it pushes.
+    if (pacer && !pipeline)
+        te_us = pacer->wait_for_te();
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        auto &r = rects[i];
+        auto data = buffer1->data() + r.y * stride + r.x;
+        auto input = std::exchange(frame_input_us, 0);
+        if (pipeline)
+        {
+            pipeline->queue(
+                {data, stride, r.x, r.y, r.w, r.h, FlushJob<PixelType>::Push, this, input});
+        }
+        else
+        {
+            flush_rect(data, stride, r.x, r.y, r.w, r.h, async_flush());
+            shown(input);
+        }
+    }
+    if (async_flush() && count && !bounced())
+    {
+        in_flight = buffer1->data();
+    }
+
+    // The mirror copies what was pushed, as it is left in the frame buffer, once the pushes are
+    // under way. A key frame copies the whole frame buffer, which is in its final layout by then.
+    if (mirror_plan == MirrorStream::Plan::Key)
+    {
+        rects[0] = {0, 0, int32_t(stride), int32_t(panel_height())};
+        count = 1;
+    }
+    for (std::size_t i = 0; i < count && mirror_plan != MirrorStream::Plan::Skip; i++)
+    {
+        auto &r = rects[i];
+        auto data = buffer1->data() + r.y * stride + r.x;
+        bool key = mirror_plan == MirrorStream::Plan::Key;
+        if (pipeline)
+            pipeline->queue({data, stride, r.x, r.y, r.w, r.h,
+                             uint8_t(key ? Job::Mirror | Job::MirrorKey : Job::Mirror), this});
+        else
+            mirror_rect(data, stride, r.x, r.y, r.w, r.h, key);
+    }
+
+    if (pipeline)
+    {
+        pipeline->queue({.flags = FlushJob<PixelType>::Release, .display = this});
+    }
+
+    if (buffer2)
+    {
+        std::swap(buffer1, buffer2);
+    }
+}
+
+template <typename PixelType>
+void FlushPipeline<PixelType>::task_main(void *arg)
+{
+    auto self = static_cast<FlushPipeline *>(arg);
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Jobs of one display are pushed in a single bus transaction.
+        LgfxDisplay<PixelType> *open = nullptr;
+        FlushJob<PixelType> job;
+        while (self->jobs.pop(job))
+        {
+            using Job = FlushJob<PixelType>;
+            auto display = job.display;
+            // The first push of a paced display's frame waits for TE here, not on the Slint
+            // task, so that it still starts in vertical blanking.
+            if ((job.flags & (Job::Packed | Job::Push)) && display->pacer && !self->te_synced)
+            {
+                self->te_us = display->pacer->wait_for_te();
+                self->te_synced = true;
+            }
+            if (display && display != open)
+            {
+                if (open && open->gfx) open->close_write();
+                if (display->gfx) display->open_write();
+                open = display;
+            }
+            if (job.flags & Job::Packed)
+                display->flush_packed(job.data, job.x, job.y, job.w, job.h);
+            if (job.flags & Job::Convert)
+                display->convert_rect(job.data, job.stride, job.x, job.y, job.w, job.h);
+            if (job.flags & Job::Push)
+                display->flush_rect(job.data, job.stride, job.x, job.y, job.w, job.h);
+            if (job.flags & Job::Mirror)
+                display->mirror_rect(job.data, job.stride, job.x, job.y, job.w, job.h,
+                                     job.flags & Job::MirrorKey);
+            if (job.flags & (Job::Packed | Job::Push))
+                display->shown(job.input_us);
+            if (job.flags & Job::Release)
+                xSemaphoreGive(display->free_buffers);
+            if (job.flags & Job::Refresh)
+            {
+                display->take_bus();
+                display->epd.refresh(display->gfx);
+            }
+            if (job.flags & Job::FrameEnd)
+            {
+                publish_stats(*self->counters);
+                self->pacer->frame_done(self->te_us ? self->te_us : job.slot_us);
+                self->te_synced = false;
+                self->te_us = 0;
+            }
+        }
+        if (open && open->gfx) open->close_write();
+    }
+}
+
+template <typename PixelType>
+MirrorFormat LgfxDisplay<PixelType>::mirror_format() const
+{
+    // Rectangles that are converted in place are mirrored after the conversion.
+    bool swapped = byte_swap && !bounced();
+    if constexpr (std::is_same_v<PixelType, slint::platform::Rgb565Pixel>)
+        return swapped ? MirrorFormat::Rgb565Swapped : MirrorFormat::Rgb565;
+    else
+        return swapped ? MirrorFormat::Bgr888 : MirrorFormat::Rgb888;
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::mirror_rect(const PixelType *data, std::size_t stride, int32_t x,
+                                          int32_t y, int32_t w, int32_t h, bool key)
+{
+    MirrorFrame frame{uint16_t(stride), uint16_t(panel_height()), mirror_format(), key};
+    mirror->rect(frame, reinterpret_cast<const uint8_t *>(data), stride * sizeof(PixelType),
+                 sizeof(PixelType), x, y, w, h);
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::finish_flush()
+{
+    if (flush_pending)
+    {
+        SLINT_PROFILE_SCOPE(Push);
+        gfx->waitDMA();
+        close_write();
+        flush_pending = false;
+    }
+    in_flight = nullptr;
+}
+
+/// Waits until the flush task has handed back every buffer, so that the caller's frame buffers
+/// are no longer read once the event loop returns.
+template <typename PixelType>
+void LgfxDisplay<PixelType>::wait_for_buffers()
+{
+    if (!pipeline)
+        return;
+    for (uint32_t i = 0; i < pipeline_buffers; i++)
+        xSemaphoreTake(free_buffers, portMAX_DELAY);
+    for (uint32_t i = 0; i < pipeline_buffers; i++)
+        xSemaphoreGive(free_buffers);
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::take_bus()
+{
+    if (!arbiter)
+        return;
+    if (holding_bus)
+    {
+        if (!arbiter->should_yield(bus_held_since, esp_timer_get_time()))
+            return;
+        arbiter->count_yield();
+        release_bus();
+    }
+    arbiter->acquire(arbiter->display_priority(), portMAX_DELAY, true);
+    gfx->startWrite();
+    holding_bus = true;
+    bus_held_since = esp_timer_get_time();
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::release_bus()
+{
+    if (!holding_bus)
+        return;
+    gfx->waitDMA();
+    gfx->endWrite();
+    holding_bus = false;
+    arbiter->release(true);
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::alloc_bands(std::size_t stride)
+{
+    // Shrink the bands rather than giving up when internal RAM is tight.
+    while (bands.size() < band_count)
+    {
+        void *ptr = arena.alloc(stride * band_lines * sizeof(PixelType), 4,
+                                MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        if (ptr)
+        {
+            bands.emplace_back(reinterpret_cast<PixelType *>(ptr), arena_free);
+        }
+        else if (band_lines > 1)
+        {
+            band_lines /= 2;
+            bands.clear();
+        }
+        else
+        {
+            ESP_LOGE(TAG, "malloc failed to allocate line buffer");
+            abort();
+        }
+    }
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::alloc_frame_buffers(SlintBufferPlacement placement, uint32_t count)
+{
+    if (buffer1)
+    {
+        ESP_LOGW(TAG, "buffer1 is set, not allocating frame buffers");
+        return;
+    }
+    auto caps = placement == SlintBufferPlacement::Psram
+                    ? MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT
+                    : MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL;
+    std::size_t pixels = std::size_t(size.width) * size.height;
+    for (uint32_t i = 0; i < std::clamp<uint32_t>(count, 1, 2); i++)
+    {
+        void *ptr = arena.alloc(pixels * sizeof(PixelType), 4, caps);
+        if (ptr)
+        {
+            frame_buffers.emplace_back(reinterpret_cast<PixelType *>(ptr), arena_free);
+        }
+        else if (i > 0)
+        {
+            ESP_LOGW(TAG, "malloc failed to allocate second frame buffer, single buffering");
+            break;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "malloc failed to allocate frame buffer");
+            abort();
+        }
+    }
+    buffer1 = std::span<PixelType>(frame_buffers[0].get(), pixels);
+    if (frame_buffers.size() > 1)
+    {
+        buffer2 = std::span<PixelType>(frame_buffers[1].get(), pixels);
+    }
+}
+
+template <typename PixelType>
+void LgfxDisplay<PixelType>::render_by_bands(std::size_t stride)
+{
+    alloc_bands(stride);
+
+    // The band being filled: consecutive lines with the same horizontal extent.
+    std::size_t band_x = 0, band_y = 0, band_width = 0, band_rows = 0;
+
+    auto flush_band = [&]
+    {
+        if (band_rows == 0)
+            return;
+        counters.rectangles++;
+        SLINT_PROFILE(profiler.add_rectangle(band_width * band_rows));
+        auto data = bands[bounce].get();
+        auto input = std::exchange(frame_input_us, 0);
+        if (pipeline)
+        {
+            pipeline->queue({data, band_width, int32_t(band_x), int32_t(band_y),
+                             int32_t(band_width), int32_t(band_rows),
+                             FlushJob<PixelType>::Packed | FlushJob<PixelType>::Release, this,
+                             input});
+        }
+        else
+        {
+            // Lines were converted as they were rendered. LovyanGFX waits for the previous
+            // transfer before starting this one, so by the time we come back to a buffer its
+            // transfer has completed, in this frame or the next.
+            push_rect(reinterpret_cast<uint8_t *>(data), band_width, band_x, band_y, band_width,
+                      band_rows, bands.size() > 1);
+            shown(input);
+        }
+        bounce = (bounce + 1) % bands.size();
+        band_rows = 0;
+    };
+
+    // Without the flush task, lines are converted as they are rendered.
+    bool convert_lines = !pipeline && converts;
+    if (pacer && !pipeline)
+        te_us = pacer->wait_for_te();
+    window->m_renderer.render_by_line<PixelType>(
+        [&](std::size_t line_y, std::size_t line_start, std::size_t line_end, auto &&render_fn)
+        {
+            auto width = line_end - line_start;
+            if (band_rows == band_lines || line_start != band_x || width != band_width ||
+                line_y != band_y + band_rows)
+            {
+                flush_band();
+            }
+            if (band_rows == 0)
+            {
+                if (pipeline)
+                {
+                    xSemaphoreTake(free_buffers, portMAX_DELAY);
+                }
+                band_x = line_start;
+                band_y = line_y;
+                band_width = width;
+            }
+
+            std::span<PixelType> view{bands[bounce].get() + band_rows * width, width};
+            {
+                SLINT_PROFILE_SCOPE(Render);
+                render_fn(view);
+            }
+            if (convert_lines)
+            {
+                // Pack the converted line right after the previous one, which stays behind the
+                // rendered pixels when the output format is smaller.
+                auto out = reinterpret_cast<uint8_t *>(bands[bounce].get());
+                convert_pixels(view.data(), out + band_rows * width * out_bpp(), width,
+                               int32_t(line_start), int32_t(line_y));
+            }
+            band_rows++;
+        });
+    flush_band();
+
+    if (gfx && !pipeline && !async_flush())
+    {
+        SLINT_PROFILE_SCOPE(Push);
+        gfx->waitDMA();
+    }
+}
+
+template <typename PixelType>
+void LgfxPlatform<PixelType>::quit_event_loop()
+{
+    events.quit = true;
+    events.notify();
+}
+
+template <typename PixelType>
+void LgfxPlatform<PixelType>::run_in_event_loop(slint::platform::Platform::Task event)
+{
+    PostedTask item{std::move(event)};
+    if (!events.post(item))
+    {
+        ESP_LOGW(TAG, "task queue full, dropping task");
+    }
+}
+
+template <typename PixelType>
+TaskHandle_t LgfxPlatform<PixelType>::task = {};
+
+template <typename PixelType>
+static void init(const SlintPlatformConfiguration<PixelType> &config)
+{
+    // Before anything else, so that the Slint runtime and the buffers start out in the arena.
+    if (config.arena_size && !arena.begin(config.arena_size, config.arena_placement))
+    {
+        ESP_LOGW(TAG, "could not reserve a %lu byte arena, using the system heap",
+                 (unsigned long)config.arena_size);
+    }
+    auto platform = std::make_unique<LgfxPlatform<PixelType>>(config);
+    active_platform<PixelType> = platform.get();
+    slint::platform::set_platform(std::move(platform));
+}
+
+void slint_esp_init(const SlintPlatformConfiguration<slint::platform::Rgb565Pixel> &config)
+{
+    init(config);
+}
+
+void slint_esp_init(const SlintPlatformConfiguration<slint::Rgb8Pixel> &config)
+{
+    init(config);
+}
+
+// With `custom_slint_arena = yes`, compile_slint.py renames the allocator calls in the Slint
+// runtime library to these. Its free() and realloc() also see blocks that the C library or
+// ESP-IDF allocated, which the arena passes on to the system heap.
+extern "C"
+{
+    void *slint_lgfx_malloc(std::size_t size)
+    {
+        return arena.alloc(size, 4, MALLOC_CAP_DEFAULT);
+    }
+
+    void *slint_lgfx_calloc(std::size_t n, std::size_t size)
+    {
+        if (size && n > SIZE_MAX / size)
+            return nullptr;
+        auto p = arena.alloc(n * size, 4, MALLOC_CAP_DEFAULT);
+        if (p)
+            std::memset(p, 0, n * size);
+        return p;
+    }
+
+    void *slint_lgfx_realloc(void *p, std::size_t size)
+    {
+        return arena.resize(p, size, MALLOC_CAP_DEFAULT);
+    }
+
+    void slint_lgfx_free(void *p)
+    {
+        if (p)
+            arena.release(p);
+    }
+
+    void *slint_lgfx_aligned_alloc(std::size_t align, std::size_t size)
+    {
+        return arena.alloc(size, align, MALLOC_CAP_DEFAULT);
+    }
+
+    void *slint_lgfx_memalign(std::size_t align, std::size_t size)
+    {
+        return arena.alloc(size, align, MALLOC_CAP_DEFAULT);
+    }
+
+    int slint_lgfx_posix_memalign(void **out, std::size_t align, std::size_t size)
+    {
+        *out = arena.alloc(size, align, MALLOC_CAP_DEFAULT);
+        return *out || !size ? 0 : ENOMEM;
+    }
+}
+
+template <typename PixelType>
+static bool add_display(const SlintDisplayConfiguration<PixelType> &config)
+{
+    auto platform = active_platform<PixelType>;
+    if (!platform)
+    {
+        ESP_LOGE(TAG, "slint_esp_add_display needs slint_esp_init with the same pixel type first");
+        return false;
+    }
+    platform->add_display(config);
+    return true;
+}
+
+bool slint_esp_add_display(const SlintDisplayConfiguration<slint::platform::Rgb565Pixel> &config)
+{
+    return add_display(config);
+}
+
+bool slint_esp_add_display(const SlintDisplayConfiguration<slint::Rgb8Pixel> &config)
+{
+    return add_display(config);
+}
+
+bool slint_esp_post(void (*fn)(void *), void *arg)
+{
+    if (!active_events)
+        return false;
+    PostedTask item{{}, fn, arg};
+    return active_events->post(item);
+}
+
+bool IRAM_ATTR slint_esp_post_from_isr(void (*fn)(void *), void *arg)
+{
+    if (!active_events)
+        return false;
+    PostedTask item{{}, fn, arg};
+    return active_events->post(item, false);
+}
+
+uint32_t slint_esp_dropped_tasks()
+{
+    return active_events ? active_events->dropped.load() : 0;
+}
+
+bool slint_esp_channel_handler(uint32_t key, void (*apply)(const void *, void *), void *arg)
+{
+    return update_channel.set_handler(key, apply, arg);
+}
+
+bool IRAM_ATTR slint_esp_channel_publish(uint32_t key, const void *value, std::size_t size)
+{
+    auto result = update_channel.publish(key, value, size);
+    if (result == UpdateChannel::Published::First && active_events)
+        active_events->notify();
+    return result != UpdateChannel::Published::Dropped;
+}
+
+SlintChannelStats slint_esp_channel_stats()
+{
+    return update_channel.stats();
+}
+
+SlintInputStats slint_esp_input_stats()
+{
+    return input_counters.stats();
+}
+
+bool slint_esp_bus_acquire(uint32_t priority, uint32_t timeout_ms)
+{
+    auto ticks = timeout_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    return bus_arbiter.acquire(priority, ticks, false);
+}
+
+void slint_esp_bus_release()
+{
+    bus_arbiter.release(false);
+}
+
+SlintBusStats slint_esp_bus_stats()
+{
+    return bus_arbiter.stats();
+}
+
+void slint_esp_mirror_start(std::size_t (*write)(const void *, std::size_t, void *), void *arg,
+                            uint32_t bytes_per_second)
+{
+    mirror_stream.start(write, arg, bytes_per_second);
+}
+
+void slint_esp_mirror_stop()
+{
+    mirror_stream.stop();
+}
+
+SlintMirrorStats slint_esp_mirror_stats()
+{
+    return mirror_stream.stats();
+}
+
+SlintArenaStats slint_esp_arena_stats()
+{
+    return arena.stats();
+}
+
+SlintMemoryStats slint_esp_memory_stats()
+{
+    return memory_monitor.stats();
+}
+
+SlintProfileSummary slint_esp_profile_summary()
+{
+#ifdef SLINT_LGFX_PROFILE
+    return profiler.summary();
+#else
+    return {};
+#endif
+}
+
+void slint_esp_profile_dump()
+{
+#ifdef SLINT_LGFX_PROFILE
+    profiler.dump();
+#endif
+    memory_monitor.dump();
+}
+
+SlintPacingStats slint_esp_pacing_stats()
+{
+    return active_pacer ? active_pacer->stats() : SlintPacingStats{};
+}
+
+SlintEpdStats slint_esp_epd_stats()
+{
+    return {epd_counters.partial, epd_counters.full, epd_counters.suppressed};
+}
+
+SlintFlushStats slint_esp_flush_stats()
 {
-    slint::platform::set_platform(std::make_unique<LgfxPlatform<slint::Rgb8Pixel>>(config));
+    return {last_flush_stats.rectangles, last_flush_stats.transactions, last_flush_stats.bytes};
 }